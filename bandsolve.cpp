@@ -0,0 +1,301 @@
+#include "bandsolve.h"
+#include <cstdint>
+using namespace std;
+
+// Cell (r, c) is bit (r % 3) * 9 + c of the word of band r / 3
+constexpr uint32_t BandMask = 0x7FFFFFF;
+constexpr uint32_t RowMask[3]{0x1FF, 0x1FF << 9, 0x1FF << 18};
+constexpr uint32_t BoxMask[3]{0x1C0E07, 0x1C0E07 << 3, 0x1C0E07 << 6};
+constexpr uint32_t ColMask(int col)
+{
+    return 0x40201 << col;
+}
+
+// The cells of a band that belong to the same row, column or box as 'pos',
+// including the cell itself
+constexpr uint32_t BandPeers(int pos)
+{
+    return RowMask[pos / 9] | BoxMask[pos % 9 / 3] | ColMask(pos % 9);
+}
+
+struct BandState
+{
+    // Bit p of cand[d][b] is set if digit d + 1 can be in cell p of band b.
+    // Solved cells keep the bit of their digit only.
+    uint32_t cand[9][3];
+    uint32_t unsolved[3];
+
+    void Init()
+    {
+        for (auto& digit : cand)
+            for (auto& band : digit)
+                band = BandMask;
+        for (auto& band : unsolved)
+            band = BandMask;
+    }
+
+    // Puts digit d + 1 into cell 'pos' of band 'b'
+    void Place(int d, int b, int pos)
+    {
+        uint32_t bit = 1u << pos;
+        for (int e = 0; e < 9; e++)
+            cand[e][b] &= ~bit;
+        for (int o = 0; o < 3; o++)
+            cand[d][o] &= ~ColMask(pos % 9);
+        cand[d][b] = (cand[d][b] & ~BandPeers(pos)) | bit;
+        unsolved[b] &= ~bit;
+    }
+
+    // Applies naked and hidden singles and locked candidates until nothing
+    // changes. Returns false if the grid has no solution.
+    bool Propagate()
+    {
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            // Naked singles: count candidates of all cells of a band at once
+            for (int b = 0; b < 3; b++)
+            {
+                if (!unsolved[b])
+                    continue;
+                uint32_t one = 0, two = 0;
+                for (int d = 0; d < 9; d++)
+                {
+                    two |= one & cand[d][b];
+                    one |= cand[d][b];
+                }
+                if (unsolved[b] & ~one)
+                    return false;
+                for (uint32_t singles = one & ~two & unsolved[b]; singles;
+                     singles &= singles - 1)
+                {
+                    int pos = __builtin_ctz(singles);
+                    uint32_t bit = 1u << pos;
+                    int d = 0;
+                    while (d < 9 && !(cand[d][b] & bit))
+                        d++;
+                    // An earlier single took the last candidate
+                    if (d == 9)
+                        return false;
+                    Place(d, b, pos);
+                    changed = true;
+                }
+            }
+            for (int d = 0; d < 9; d++)
+            {
+                // No unsolved cell can take the digit any more
+                if (!(cand[d][0] & unsolved[0]) &&
+                    !(cand[d][1] & unsolved[1]) &&
+                    !(cand[d][2] & unsolved[2]))
+                    continue;
+                // Hidden singles in rows and boxes, locked candidates
+                for (int b = 0; b < 3; b++)
+                {
+                    uint32_t& c = cand[d][b];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        uint32_t row = c & RowMask[k], box = c & BoxMask[k];
+                        if (!row || !box)
+                            return false;
+                        if (!(row & (row - 1)) && (row & unsolved[b]))
+                        {
+                            Place(d, b, __builtin_ctz(row));
+                            changed = true;
+                        }
+                        else if (!(box & (box - 1)) && (box & unsolved[b]))
+                        {
+                            Place(d, b, __builtin_ctz(box));
+                            changed = true;
+                        }
+                    }
+                    for (int k = 0; k < 3; k++)
+                    {
+                        uint32_t box = c & BoxMask[k];
+                        for (int r = 0; r < 3; r++)
+                        {
+                            uint32_t row = c & RowMask[r];
+                            uint32_t drop = 0;
+                            // Pointing: the box's candidates lie in one row
+                            if (box && !(box & ~RowMask[r]))
+                                drop |= RowMask[r] & ~BoxMask[k];
+                            // Claiming: the row's candidates lie in one box
+                            if (row && !(row & ~BoxMask[k]))
+                                drop |= BoxMask[k] & ~RowMask[r];
+                            if (c & drop)
+                            {
+                                c &= ~drop;
+                                changed = true;
+                            }
+                        }
+                    }
+                }
+                // Hidden singles in columns: fold the nine rows together
+                uint32_t one = 0, two = 0;
+                for (int b = 0; b < 3; b++)
+                    for (int r = 0; r < 3; r++)
+                    {
+                        uint32_t row = cand[d][b] >> 9 * r & 0x1FF;
+                        two |= one & row;
+                        one |= row;
+                    }
+                if (one != 0x1FF)
+                    return false;
+                for (uint32_t cols = one & ~two; cols; cols &= cols - 1)
+                {
+                    int col = __builtin_ctz(cols);
+                    for (int b = 0; b < 3; b++)
+                    {
+                        uint32_t bit = cand[d][b] & ColMask(col);
+                        if (bit & unsolved[b])
+                        {
+                            Place(d, b, __builtin_ctz(bit));
+                            changed = true;
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // Picks the unsolved cell to guess on, preferring one with exactly two
+    // candidates. Returns its band and position through 'b' and 'pos'.
+    void PickCell(int& b, int& pos) const
+    {
+        int fallbackBand = -1, fallbackPos = 0;
+        for (b = 0; b < 3; b++)
+        {
+            if (!unsolved[b])
+                continue;
+            uint32_t one = 0, two = 0, three = 0;
+            for (int d = 0; d < 9; d++)
+            {
+                three |= two & cand[d][b];
+                two |= one & cand[d][b];
+                one |= cand[d][b];
+            }
+            uint32_t pairs = two & ~three & unsolved[b];
+            if (pairs)
+            {
+                pos = __builtin_ctz(pairs);
+                return;
+            }
+            if (fallbackBand == -1)
+            {
+                fallbackBand = b;
+                fallbackPos = __builtin_ctz(unsolved[b]);
+            }
+        }
+        b = fallbackBand;
+        pos = fallbackPos;
+    }
+
+    void Extract(SolutionGrid& grid) const
+    {
+        for (int d = 0; d < 9; d++)
+            for (int b = 0; b < 3; b++)
+                for (uint32_t c = cand[d][b]; c; c &= c - 1)
+                    grid[27 * b + __builtin_ctz(c)] = d + 1;
+    }
+};
+
+struct BandSearch
+{
+    long long found = 0, maxresults;
+    SolutionVisitor visitor;
+    void* visitorArgs;
+    const atomic<bool>* cancel;
+    bool stopped = false;
+
+    void Search(BandState& st)
+    {
+        if (!st.Propagate())
+            return;
+        if (!(st.unsolved[0] | st.unsolved[1] | st.unsolved[2]))
+        {
+            found++;
+            if (visitor)
+            {
+                SolutionGrid grid;
+                st.Extract(grid);
+                if (!visitor(grid, visitorArgs))
+                    stopped = true;
+            }
+            if (found == maxresults)
+                stopped = true;
+            return;
+        }
+        if (cancel && cancel->load(memory_order_relaxed))
+        {
+            stopped = true;
+            return;
+        }
+        int b, pos;
+        st.PickCell(b, pos);
+        for (int d = 0; d < 9 && !stopped; d++)
+        {
+            if (!(st.cand[d][b] & 1u << pos))
+                continue;
+            BandState next = st;
+            next.Place(d, b, pos);
+            Search(next);
+        }
+    }
+};
+
+long long EnumerateSolutionsBands(const Sudoku& s, long long maxresults,
+                                  SolutionVisitor visitor, void* visitorArgs,
+                                  const atomic<bool>* cancel)
+{
+    BandState st;
+    st.Init();
+    for (int cell = 0; cell < 81; cell++)
+    {
+        int digit = s.Cell(cell / 9, cell % 9);
+        if (!digit)
+            continue;
+        int b = cell / 27, pos = cell % 27;
+        // The givens already clash: no solutions
+        if (!(st.cand[digit - 1][b] & 1u << pos))
+            return 0;
+        st.Place(digit - 1, b, pos);
+    }
+    BandSearch search;
+    search.maxresults = maxresults;
+    search.visitor = visitor;
+    search.visitorArgs = visitorArgs;
+    search.cancel = cancel;
+    search.Search(st);
+    return search.found;
+}
+
+std::vector<Sudoku> SolveBands(const Sudoku& s, int maxresults)
+{
+    // Solutions keep the 'initial' flags of 's'
+    pair<const Sudoku*, vector<Sudoku>*> args;
+    vector<Sudoku> res;
+    args = {&s, &res};
+    EnumerateSolutionsBands(
+        s, maxresults,
+        [](const SolutionGrid& grid, void* params) {
+            auto [orig, sols] =
+                *(pair<const Sudoku*, vector<Sudoku>*>*)params;
+            Sudoku sol = *orig;
+            for (int cell = 0; cell < 81; cell++)
+                sol.Cell(cell / 9, cell % 9) = grid[cell];
+            sols->push_back(sol);
+            return true;
+        },
+        &args);
+    return res;
+}
+
+bool SolveBands(Sudoku& s)
+{
+    auto res = SolveBands(s, 1);
+    if (res.empty())
+        return false;
+    s = res[0];
+    return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include "sudoku.h"
+#include "sudokusolve.h"
+#include <atomic>
+#include <vector>
+
+// A solver that keeps the candidates of every digit as three 27-bit words,
+// one per band of three rows, and propagates singles and locked candidates
+// with whole-band bit operations before it guesses. The functions mirror
+// the ones in sudokusolve.h.
+
+std::vector<Sudoku> SolveBands(const Sudoku& s, int maxresults);
+bool SolveBands(Sudoku& s);
+long long EnumerateSolutionsBands(const Sudoku& s, long long maxresults,
+                                  SolutionVisitor visitor, void* visitorArgs,
+                                  const std::atomic<bool>* cancel = nullptr);
@@ -52,53 +52,282 @@ ostream& operator<<(ostream& out, const Stats& stats)
     return out << "SD = " << stats.SD << '\n';
 }
 
-int main(int argc, char** argv)
+// A single run of a solution
+struct Measurement
+{
+    // Wall time in seconds
+    double Wall;
+    ResourceUsage Usage;
+};
+
+// Runs the solution once on the testcase
+Measurement MeasureRun(const string& progFilename, const string& testcase)
+{
+    Process proc(progFilename, {progFilename}, {});
+    fputs(testcase.c_str(), proc.StdIN());
+    fflush(proc.StdIN());
+    auto starttime = chrono::steady_clock::now();
+    proc.Wait();
+    auto endtime = chrono::steady_clock::now();
+    auto dur = endtime - starttime;
+    using frac = decltype(dur)::period;
+    return {dur.count() * frac::num / (double)frac::den, proc.Usage()};
+}
+
+// Reads all files in the directory, sorted by name
+vector<pair<string, string>> ReadTests(const string& testDir)
 {
-    if (argc != 4)
-    {
-        cout << "Usage: benchmark solution.bin repeats testDir" << endl;
-        return 1;
-    }
-    string progFilename = argv[1];
-    int repeats = atoi(argv[2]);
-    string testDir = argv[3];
-    map<string, vector<double>> benchmarks;
     vector<filesystem::path> entries;
     for (auto& entry : filesystem::directory_iterator(testDir))
         entries.push_back(entry.path());
     sort(entries.begin(), entries.end());
+    vector<pair<string, string>> tests;
     for (auto& entry : entries)
     {
-        string testcase;
+        stringstream testin;
+        testin << ifstream(entry, ios::in).rdbuf();
+        tests.emplace_back(entry.filename().string(), testin.str());
+    }
+    return tests;
+}
+
+// The result of the two-sided Mann-Whitney U test
+struct MannWhitney
+{
+    // U statistic of the first sample
+    double U;
+    // The probability of seeing such a difference if both samples come from
+    // the same distribution (normal approximation with a tie correction)
+    double P;
+    MannWhitney(const vector<double>& a, const vector<double>& b)
+    {
+        size_t na = a.size(), nb = b.size();
+        vector<pair<double, bool>> all;
+        for (double x : a)
+            all.emplace_back(x, false);
+        for (double x : b)
+            all.emplace_back(x, true);
+        sort(all.begin(), all.end());
+        size_t n = all.size();
+        // Sum of the ranks of the first sample; equal values share the
+        // average rank
+        double ranksA = 0, tieTerm = 0;
+        for (size_t i = 0; i < n;)
+        {
+            size_t j = i;
+            while (j < n && all[j].first == all[i].first)
+                j++;
+            double rank = (i + 1 + j) / 2.0;
+            for (size_t k = i; k < j; k++)
+                if (!all[k].second)
+                    ranksA += rank;
+            double t = j - i;
+            tieTerm += t * t * t - t;
+            i = j;
+        }
+        U = ranksA - na * (na + 1) / 2.0;
+        double mean = na * nb / 2.0;
+        double var = na * nb / 12.0 * (n + 1 - tieTerm / (n * (n - 1.0)));
+        if (var <= 0)
         {
-            stringstream testin;
-            testin << ifstream(entry, ios::in).rdbuf();
-            testcase = testin.str();
+            P = 1;
+            return;
         }
-        string testFilename = entry.filename().string();
+        // Continuity correction
+        double z = (fabs(U - mean) - 0.5) / sqrt(var);
+        P = min(1.0, erfc(max(z, 0.0) / sqrt(2.0)));
+    }
+};
+
+// Runs both solutions interleaved on every test, reports per-bucket speedups.
+// Returns 2 if some bucket is significantly slower than 'maxSlowdown' allows.
+int Compare(const string& baseFilename, const string& newFilename, int repeats,
+            const string& testDir, double maxSlowdown)
+{
+    const double Alpha = 0.05;
+    // Buckets are the numbers of given digits
+    map<int, vector<double>> baseTimes, newTimes;
+    for (auto& [testFilename, testcase] : ReadTests(testDir))
+    {
+        int given = 81 - count(testcase.begin(), testcase.end(), '-');
         cout << "Testing on " << testFilename << "..." << endl;
-        vector<double>& curBenchmarks = benchmarks[testFilename];
-        cout << '\r' << "0/" << repeats;
         for (int i = 1; i <= repeats; i++)
         {
-            cout.flush();
-            Process proc(progFilename, {}, {});
-            fputs(testcase.c_str(), proc.StdIN());
-            auto starttime = chrono::steady_clock::now();
-            proc.Wait();
-            auto endtime = chrono::steady_clock::now();
-            auto dur = endtime - starttime;
-            using frac = decltype(dur)::period;
-            curBenchmarks.push_back(dur.count() * frac::num /
-                                    (double)frac::den);
+            // Alternate the order so that drift affects both sides equally
+            if (i & 1)
+            {
+                baseTimes[given].push_back(
+                    MeasureRun(baseFilename, testcase).Wall);
+                newTimes[given].push_back(
+                    MeasureRun(newFilename, testcase).Wall);
+            }
+            else
+            {
+                newTimes[given].push_back(
+                    MeasureRun(newFilename, testcase).Wall);
+                baseTimes[given].push_back(
+                    MeasureRun(baseFilename, testcase).Wall);
+            }
             cout << '\r' << i << '/' << repeats;
+            cout.flush();
+        }
+        cout << endl;
+    }
+    cout << "--Comparison--\n";
+    cout << "Bucket: base median, new median, speedup, p-value\n";
+    bool regressed = false;
+    for (auto& [given, baseV] : baseTimes)
+    {
+        auto& newV = newTimes[given];
+        Stats sb(baseV), sn(newV);
+        MannWhitney test(baseV, newV);
+        double speedup = sb.Median / sn.Median;
+        bool significant = test.P < Alpha;
+        bool slow = significant && 1 / speedup > maxSlowdown;
+        regressed |= slow;
+        cout << given << ": " << sb.Median << ", " << sn.Median << ", "
+             << speedup << "x, p = " << test.P;
+        if (slow)
+            cout << " REGRESSION";
+        else if (significant)
+            cout << (speedup > 1 ? " faster" : " slower");
+        cout << '\n';
+    }
+    cout.flush();
+    return regressed ? 2 : 0;
+}
+
+// Measures the cost of starting and reaping a trivial child with both launch
+// paths of Process. 'parentMB' megabytes are touched first, since fork() has
+// to copy the page tables of the parent.
+int LaunchOverhead(int launches, int parentMB)
+{
+    vector<char> ballast((size_t)parentMB << 20, 1);
+    auto measure = [&](bool spawn) {
+        auto starttime = chrono::steady_clock::now();
+        for (int i = 0; i < launches; i++)
+        {
+            if (spawn)
+                Process("/bin/true", {"true"}, {}).Wait();
+            else
+                Process("/bin/true", {"true"}, {}, [](void*) {}, 0).Wait();
+        }
+        chrono::duration<double, micro> dur =
+            chrono::steady_clock::now() - starttime;
+        return dur.count() / launches;
+    };
+    cout << "Parent size: " << parentMB << " MB\n";
+    cout << "fork + execve: " << measure(false) << " us per launch\n";
+    cout << "posix_spawn: " << measure(true) << " us per launch" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "--launch-overhead") == 0)
+    {
+        if (argc != 3 && argc != 4)
+        {
+            cout << "Usage: benchmark --launch-overhead launches "
+                    "[parentMB=0]"
+                 << endl;
+            return 1;
+        }
+        return LaunchOverhead(atoi(argv[2]), argc == 4 ? atoi(argv[3]) : 0);
+    }
+    if (argc >= 2 && strcmp(argv[1], "--compare") == 0)
+    {
+        if (argc != 6 && argc != 7)
+        {
+            cout << "Usage: benchmark --compare base.bin new.bin repeats "
+                    "testDir [maxSlowdown=1.1]"
+                 << endl;
+            return 1;
+        }
+        double maxSlowdown = argc == 7 ? atof(argv[6]) : 1.1;
+        return Compare(argv[2], argv[3], atoi(argv[4]), argv[5], maxSlowdown);
+    }
+    if (argc != 4 && argc != 5)
+    {
+        cout << "Usage: benchmark solution.bin repeats testDir [jobs=1]\n"
+                "       benchmark --compare base.bin new.bin repeats testDir "
+                "[maxSlowdown=1.1]\n"
+                "       benchmark --launch-overhead launches [parentMB=0]"
+             << endl;
+        return 1;
+    }
+    string progFilename = argv[1];
+    int repeats = atoi(argv[2]);
+    string testDir = argv[3];
+    int jobs = argc == 5 ? atoi(argv[4]) : 1;
+    map<string, vector<Measurement>> benchmarks;
+    if (jobs > 1)
+    {
+        // Parallel runs compete for the CPU and memory bandwidth, so the
+        // times are only comparable with runs made with the same 'jobs'
+        ProcessPool pool(jobs);
+        vector<string> names;
+        for (auto& [testFilename, testcase] : ReadTests(testDir))
+            for (int i = 0; i < repeats; i++)
+            {
+                names.push_back(testFilename);
+                pool.Submit(progFilename, {progFilename}, {}, testcase);
+            }
+        PoolResult res;
+        for (size_t done = 1; pool.Next(res); done++)
+        {
+            benchmarks[names[res.Job]].push_back({res.Wall, res.Usage});
+            cout << '\r' << done << '/' << names.size();
+            cout.flush();
         }
         cout << endl;
     }
+    else
+        for (auto& [testFilename, testcase] : ReadTests(testDir))
+        {
+            cout << "Testing on " << testFilename << "..." << endl;
+            vector<Measurement>& curBenchmarks = benchmarks[testFilename];
+            cout << '\r' << "0/" << repeats;
+            for (int i = 1; i <= repeats; i++)
+            {
+                cout.flush();
+                curBenchmarks.push_back(MeasureRun(progFilename, testcase));
+                cout << '\r' << i << '/' << repeats;
+            }
+            cout << endl;
+        }
     cout << "--Stats--\n";
     for (auto& p : benchmarks)
     {
-        cout << p.first << ": " << p.second << '\n';
-        cout << Stats(p.second) << '\n';
+        // Extracts one field of every measurement
+        auto column = [&](auto field) {
+            vector<double> res;
+            for (auto& m : p.second)
+                res.push_back(field(m));
+            return res;
+        };
+        auto wall = column([](const Measurement& m) { return m.Wall; });
+        cout << p.first << ": " << wall << '\n';
+        cout << Stats(wall);
+        cout << "User CPU: " << Stats(column([](const Measurement& m) {
+            return m.Usage.UserTime;
+        })).Mean << '\n';
+        cout << "Sys CPU: " << Stats(column([](const Measurement& m) {
+            return m.Usage.SysTime;
+        })).Mean << '\n';
+        cout << "Max RSS (KB): " << Stats(column([](const Measurement& m) {
+            return (double)m.Usage.MaxRSS;
+        })).Max << '\n';
+        cout << "Minor faults: " << Stats(column([](const Measurement& m) {
+            return (double)m.Usage.MinorFaults;
+        })).Mean << '\n';
+        cout << "Major faults: " << Stats(column([](const Measurement& m) {
+            return (double)m.Usage.MajorFaults;
+        })).Mean << '\n';
+        cout << "Context switches: " << Stats(column([](const Measurement& m) {
+            return (double)m.Usage.VolContextSwitches;
+        })).Mean << " voluntary, " << Stats(column([](const Measurement& m) {
+            return (double)m.Usage.InvolContextSwitches;
+        })).Mean << " involuntary\n\n";
     }
 }
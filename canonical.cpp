@@ -0,0 +1,150 @@
+#include "canonical.h"
+#include <cstring>
+#include <vector>
+using namespace std;
+
+SolutionGrid ApplyTransform(const SymmetryTransform& t, const SolutionGrid& g)
+{
+    SolutionGrid out;
+    for (int r = 0; r < 9; r++)
+        for (int c = 0; c < 9; c++)
+        {
+            int sr = t.rows[r], sc = t.cols[c];
+            out[r * 9 + c] =
+                t.digits[t.transpose ? g[sc * 9 + sr] : g[sr * 9 + sc]];
+        }
+    return out;
+}
+
+SolutionGrid ApplyInverse(const SymmetryTransform& t, const SolutionGrid& g)
+{
+    uint8_t inverse[10]{};
+    for (int d = 0; d < 10; d++)
+        inverse[t.digits[d]] = d;
+    SolutionGrid out;
+    for (int r = 0; r < 9; r++)
+        for (int c = 0; c < 9; c++)
+        {
+            int sr = t.rows[r], sc = t.cols[c];
+            out[t.transpose ? sc * 9 + sr : sr * 9 + sc] =
+                inverse[g[r * 9 + c]];
+        }
+    return out;
+}
+
+// All 6^4 = 1296 column permutations that keep the stacks together
+static vector<array<uint8_t, 9>> ColumnPermutations()
+{
+    static const uint8_t perms[6][3]{{0, 1, 2}, {0, 2, 1}, {1, 0, 2},
+                                     {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    vector<array<uint8_t, 9>> res;
+    for (auto& stacks : perms)
+        for (auto& p0 : perms)
+            for (auto& p1 : perms)
+                for (auto& p2 : perms)
+                {
+                    const uint8_t* within[3]{p0, p1, p2};
+                    array<uint8_t, 9> cols;
+                    for (int s = 0; s < 3; s++)
+                        for (int i = 0; i < 3; i++)
+                            cols[s * 3 + i] = stacks[s] * 3 + within[s][i];
+                    res.push_back(cols);
+                }
+    return res;
+}
+
+// Builds the minlex form row by row. 'best' holds the smallest grid whose
+// prefix matches the rows chosen so far; rows that are not decided yet are
+// 0xFF, so the first candidate for a row always wins. A candidate row that
+// is larger than the row in 'best' cuts off its whole subtree.
+class MinlexSearch
+{
+    SolutionGrid src;
+    const array<uint8_t, 9>* cols;
+    SymmetryTransform cur;
+
+public:
+    SolutionGrid best;
+    SymmetryTransform bestTransform;
+
+    MinlexSearch()
+    {
+        best.fill(0xFF);
+    }
+
+    void Start(const SolutionGrid& g, bool transpose,
+               const array<uint8_t, 9>& columns)
+    {
+        for (int r = 0; r < 9; r++)
+            for (int c = 0; c < 9; c++)
+                src[r * 9 + c] = transpose ? g[c * 9 + r] : g[r * 9 + c];
+        cols = &columns;
+        cur.transpose = transpose;
+        memcpy(cur.cols, columns.data(), 9);
+        uint8_t digits[10]{};
+        Search(0, 0, 0, -1, digits, 1);
+    }
+
+    // 'row' is the output row to fill; 'usedBands' and 'usedRows' are masks
+    // of the source bands and rows taken; 'band' is the source band of the
+    // current output band
+    void Search(int row, int usedBands, int usedRows, int band,
+                const uint8_t* digits, int nextDigit)
+    {
+        if (row == 9)
+        {
+            // The path matches 'best' completely
+            bestTransform = cur;
+            memcpy(bestTransform.digits, digits, 10);
+            int next = nextDigit;
+            // Digits that do not occur in the puzzle still need labels
+            for (int d = 1; d <= 9; d++)
+                if (!bestTransform.digits[d])
+                    bestTransform.digits[d] = next++;
+            return;
+        }
+        for (int b = 0; b < 3; b++)
+        {
+            if (row % 3 == 0 ? usedBands >> b & 1 : b != band)
+                continue;
+            for (int sr = b * 3; sr < b * 3 + 3; sr++)
+            {
+                if (usedRows >> sr & 1)
+                    continue;
+                uint8_t map[10], line[9];
+                memcpy(map, digits, 10);
+                int next = nextDigit;
+                for (int c = 0; c < 9; c++)
+                {
+                    int v = src[sr * 9 + (*cols)[c]];
+                    if (v && !map[v])
+                        map[v] = next++;
+                    line[c] = map[v];
+                }
+                int cmp = memcmp(line, &best[row * 9], 9);
+                if (cmp > 0)
+                    continue;
+                if (cmp < 0)
+                {
+                    memcpy(&best[row * 9], line, 9);
+                    memset(&best[row * 9 + 9], 0xFF, 81 - row * 9 - 9);
+                }
+                cur.rows[row] = sr;
+                Search(row + 1, usedBands | 1 << b, usedRows | 1 << sr, b, map,
+                       next);
+            }
+        }
+    }
+};
+
+SolutionGrid Canonicalize(const SolutionGrid& g, SymmetryTransform* transform)
+{
+    static const auto colPerms = ColumnPermutations();
+    MinlexSearch search;
+    for (int transpose = 0; transpose < 2; transpose++)
+        for (auto& cols : colPerms)
+            search.Start(g, transpose, cols);
+    if (transform)
+        *transform = search.bestTransform;
+    return search.best;
+}
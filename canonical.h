@@ -0,0 +1,25 @@
+#pragma once
+#include "solutiongrid.h"
+#include <cstdint>
+
+// An element of the sudoku symmetry group: optional transposition, a
+// permutation of the rows and of the columns that keeps bands and stacks
+// together, and a relabeling of the digits. Applied to grid 'g', it gives
+// out[r][c] = digits[g'[rows[r]][cols[c]]], where g' is g transposed if
+// 'transpose' is set. Empty cells (0) stay empty.
+struct SymmetryTransform
+{
+    bool transpose;
+    uint8_t rows[9], cols[9];
+    uint8_t digits[10];
+};
+
+SolutionGrid ApplyTransform(const SymmetryTransform& t, const SolutionGrid& g);
+// Undoes ApplyTransform: ApplyInverse(t, ApplyTransform(t, g)) == g
+SolutionGrid ApplyInverse(const SymmetryTransform& t, const SolutionGrid& g);
+// Returns the minlex form of a puzzle or a solved grid: the lexicographically
+// smallest grid (row by row, empty cells as 0) among all of its images under
+// the symmetry group. Equivalent puzzles have equal canonical forms. If
+// 'transform' is given, it receives a transform that maps 'g' to the result.
+SolutionGrid Canonicalize(const SolutionGrid& g,
+                          SymmetryTransform* transform = nullptr);
@@ -0,0 +1,83 @@
+#include "canonical.h"
+#include "sudoku.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+SolutionGrid ToGrid(const Sudoku& s)
+{
+    SolutionGrid g;
+    for (int cell = 0; cell < 81; cell++)
+        g[cell] = s.Cell(cell / 9, cell % 9);
+    return g;
+}
+
+// Reads a puzzle written as 81 characters, where '1'-'9' are digits and
+// anything else is an empty cell
+bool ParseLine(const string& line, SolutionGrid& g)
+{
+    if (line.size() < 81)
+        return false;
+    for (int cell = 0; cell < 81; cell++)
+    {
+        char ch = line[cell];
+        g[cell] = ch >= '1' && ch <= '9' ? ch - '0' : 0;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        cout << "Usage: dedup testDir...\n"
+                "       dedup --corpus < puzzles.txt > unique.txt"
+             << endl;
+        return 1;
+    }
+    map<SolutionGrid, string> seen;
+    if (strcmp(argv[1], "--corpus") == 0)
+    {
+        // One puzzle per line; the first puzzle of every class is kept
+        string line;
+        long long total = 0;
+        while (getline(cin, line))
+        {
+            SolutionGrid g;
+            if (!ParseLine(line, g))
+                continue;
+            total++;
+            if (seen.emplace(Canonicalize(g), "").second)
+                cout << line << '\n';
+        }
+        cerr << "Kept " << seen.size() << " of " << total << endl;
+        return 0;
+    }
+    int total = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        vector<filesystem::path> entries;
+        for (auto& entry : filesystem::directory_iterator(argv[i]))
+            entries.push_back(entry.path());
+        sort(entries.begin(), entries.end());
+        for (auto& entry : entries)
+        {
+            ifstream in(entry);
+            Sudoku s;
+            in >> s;
+            total++;
+            auto [it, inserted] =
+                seen.emplace(Canonicalize(ToGrid(s)), entry.string());
+            // A duplicate and the file it repeats
+            if (!inserted)
+                cout << entry.string() << ' ' << it->second << '\n';
+        }
+    }
+    cout << "Unique " << seen.size() << " of " << total << endl;
+}
@@ -1,12 +1,73 @@
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <string>
+#include "bandsolve.h"
+#include "solutioncache.h"
 #include "sudokusolve.h"
 using namespace std;
 
+// Writes a solution as one line of 81 digits
+bool StreamSolution(const SolutionGrid& grid, void*)
+{
+    char line[82];
+    for (int i = 0; i < 81; i++)
+        line[i] = '0' + grid[i];
+    line[81] = '\n';
+    cout.write(line, sizeof(line));
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    int nsol = 1;
-    if (argc == 2)
-        nsol = atoi(argv[1]);
+    // --count: only print the number of solutions
+    // --stream: print every solution as a line of 81 digits as it is found
+    // In both modes, all solutions are enumerated unless a limit is given.
+    // --threads N: split the search between N threads in these modes
+    // --bands: use the band solver (single-threaded)
+    // --cache file: look the puzzle up in a solution cache before solving it
+    // and add the solution afterwards (only when one solution is requested)
+    // --cache-stats file: print the size and the hit rate of a cache
+    bool count = false, stream = false, bands = false;
+    string cacheFile;
+    int nsol = -1, threads = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--count") == 0)
+            count = true;
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = true;
+        else if (strcmp(argv[i], "--bands") == 0)
+            bands = true;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+            cacheFile = argv[++i];
+        else if (strcmp(argv[i], "--cache-stats") == 0 && i + 1 < argc)
+        {
+            unique_ptr<SolutionCache> cachePtr;
+            try
+            {
+                cachePtr = make_unique<SolutionCache>(argv[++i]);
+            }
+            catch (const exception& e)
+            {
+                cerr << "Cannot use the cache: " << e.what() << endl;
+                return 1;
+            }
+            SolutionCache& cache = *cachePtr;
+            uint64_t hits = cache.Hits(), misses = cache.Misses();
+            cout << "Entries " << cache.Size() << "\nHits " << hits
+                 << "\nMisses " << misses << "\nHit rate "
+                 << (hits + misses ? (double)hits / (hits + misses) : 0)
+                 << endl;
+            return 0;
+        }
+        else
+            nsol = atoi(argv[i]);
+    }
+    if (nsol < 0)
+        nsol = count || stream ? 0 : 1;
     Sudoku s;
     for (int i = 0; i < 9; i++)
     {
@@ -19,7 +80,56 @@ int main(int argc, char** argv)
         }
     }
     s.FreezeAll();
-    auto res = SolveDFS(s, nsol);
+    if (count || stream)
+    {
+        ios::sync_with_stdio(false);
+        SolutionVisitor visitor = stream ? StreamSolution : nullptr;
+        long long found =
+            bands ? EnumerateSolutionsBands(s, nsol, visitor, nullptr)
+            : threads > 1
+                ? EnumerateSolutionsParallel(s, nsol, visitor, nullptr, threads)
+                : EnumerateSolutions(s, nsol, visitor, nullptr);
+        if (count)
+            cout << found << '\n';
+        return 0;
+    }
+    unique_ptr<SolutionCache> cache;
+    unique_ptr<SolutionCache::Key> key;
+    vector<Sudoku> res;
+    if (!cacheFile.empty() && nsol == 1)
+    {
+        try
+        {
+            cache = make_unique<SolutionCache>(cacheFile);
+        }
+        catch (const exception& e)
+        {
+            cerr << "Cannot use the cache: " << e.what() << endl;
+            return 1;
+        }
+        SolutionGrid puzzle, solution;
+        for (int cell = 0; cell < 81; cell++)
+            puzzle[cell] = s.Cell(cell / 9, cell % 9);
+        key = make_unique<SolutionCache::Key>(puzzle);
+        if (cache->Lookup(*key, solution))
+        {
+            Sudoku sol = s;
+            for (int cell = 0; cell < 81; cell++)
+                sol.Cell(cell / 9, cell % 9) = solution[cell];
+            res.push_back(sol);
+        }
+    }
+    if (res.empty())
+    {
+        res = bands ? SolveBands(s, nsol) : SolveDFS(s, nsol);
+        if (cache && !res.empty())
+        {
+            SolutionGrid solution;
+            for (int cell = 0; cell < 81; cell++)
+                solution[cell] = res[0].Cell(cell / 9, cell % 9);
+            cache->Store(*key, solution);
+        }
+    }
     bool special = false;
     for (int si = 0; si < res.size(); si++)
     {
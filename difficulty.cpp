@@ -1,49 +1,418 @@
 #include <bits/stdc++.h>
+#include "grader.h"
+#include "launcher.h"
+#include "propagate.h"
 #include "sudoku.h"
+#include "sudokusolve.h"
+#include <sys/wait.h>
 using namespace std;
 
+// Cheap properties of a puzzle that hint how hard it is for each engine
+struct Features
+{
+    int Givens;
+    // Filled cells after the trivial steps (naked singles until none are left)
+    int AfterTrivial;
+    // How many passes of the trivial steps made progress
+    int Rounds;
+    // The total number of candidates of the empty cells after the trivial
+    // steps, and how many of these cells have exactly two
+    int Candidates, Bivalue;
+
+    // The old difficulty score
+    int Score() const
+    {
+        return 81 - (Givens + 2 * AfterTrivial) / 3;
+    }
+    // The inputs of the cost model, starting with the intercept
+    vector<double> Vector() const
+    {
+        return {1,      (double)Givens,     (double)AfterTrivial,
+                (double)Rounds, (double)Candidates, (double)Bivalue};
+    }
+};
+
+// Fills naked singles into 'sd' until none are left and measures it
+Features Analyze(Sudoku& sd)
+{
+    Features f{};
+    f.Givens = sd.NonzeroCount();
+    SolutionGrid g;
+    for (int cell = 0; cell < 81; cell++)
+        g[cell] = sd[cell / 9][cell % 9];
+    Propagator p(g);
+    // Rounds are row-major scans, as the calibrated models were fitted on
+    // them; the masks are kept up to date by the propagator instead of being
+    // recomputed for every cell
+    while (true)
+    {
+        bool ok = false;
+        for (int cell = 0; cell < 81; cell++)
+        {
+            uint16_t c = p.Candidates(cell);
+            if (p.Value(cell) || !c || (c & (c - 1)))
+                continue;
+            p.Assign(cell, __builtin_ctz(c));
+            ok = true;
+        }
+        if (!ok)
+            break;
+        f.Rounds++;
+    }
+    for (int cell = 0; cell < 81; cell++)
+    {
+        sd.Cell(cell / 9, cell % 9) = p.Value(cell);
+        if (p.Value(cell))
+            continue;
+        int cnt = __builtin_popcount(p.Candidates(cell));
+        f.Candidates += cnt;
+        f.Bivalue += cnt == 2;
+    }
+    f.AfterTrivial = sd.NonzeroCount();
+    return f;
+}
+
+Sudoku ReadSudoku(const string& filename)
+{
+    ifstream fs(filename);
+    Sudoku sd;
+    fs >> sd;
+    return sd;
+}
+
+vector<filesystem::path> ListTests(const string& testDir)
+{
+    vector<filesystem::path> entries;
+    for (auto& entry : filesystem::directory_iterator(testDir))
+        entries.push_back(entry.path());
+    sort(entries.begin(), entries.end());
+    return entries;
+}
+
+// Reads the per-test wall times from the "--Stats--" section of the output
+// of benchmark.bin and returns the median time of every test
+map<string, double> ReadBenchmark(const string& filename)
+{
+    ifstream in(filename);
+    map<string, double> res;
+    string line;
+    bool stats = false;
+    while (getline(in, line))
+    {
+        if (line == "--Stats--")
+            stats = true;
+        size_t colon = line.find(": { ");
+        if (!stats || colon == string::npos)
+            continue;
+        vector<double> times;
+        stringstream values(line.substr(colon + 4));
+        double t;
+        while (values >> t)
+        {
+            times.push_back(t);
+            values.ignore(2);
+        }
+        if (times.empty())
+            continue;
+        sort(times.begin(), times.end());
+        res[line.substr(0, colon)] = times[times.size() / 2];
+    }
+    return res;
+}
+
+// Solves the least squares problem X * beta = y, with a small ridge term in
+// case some features are constant
+vector<double> FitLeastSquares(const vector<vector<double>>& X,
+                               const vector<double>& y)
+{
+    int k = X[0].size();
+    vector<vector<double>> a(k, vector<double>(k + 1));
+    for (size_t r = 0; r < X.size(); r++)
+        for (int i = 0; i < k; i++)
+        {
+            for (int j = 0; j < k; j++)
+                a[i][j] += X[r][i] * X[r][j];
+            a[i][k] += X[r][i] * y[r];
+        }
+    for (int i = 0; i < k; i++)
+        a[i][i] += 1e-6;
+    // Gaussian elimination with partial pivoting
+    for (int col = 0; col < k; col++)
+    {
+        int pivot = col;
+        for (int i = col + 1; i < k; i++)
+            if (abs(a[i][col]) > abs(a[pivot][col]))
+                pivot = i;
+        swap(a[col], a[pivot]);
+        for (int i = 0; i < k; i++)
+        {
+            if (i == col)
+                continue;
+            double factor = a[i][col] / a[col][col];
+            for (int j = col; j <= k; j++)
+                a[i][j] -= factor * a[col][j];
+        }
+    }
+    vector<double> beta(k);
+    for (int i = 0; i < k; i++)
+        beta[i] = a[i][k] / a[i][i];
+    return beta;
+}
+
+// Fits log(seconds) of every engine as a linear function of the features
+// and prints the model
+int Calibrate(const string& testDir, const vector<string>& engineArgs)
+{
+    cout << "# engine: coefficients of log(seconds) for intercept, givens, "
+            "after trivial steps, rounds, candidates, bivalue cells\n";
+    for (const string& arg : engineArgs)
+    {
+        size_t eq = arg.find('=');
+        if (eq == string::npos)
+        {
+            cerr << "Expected engine=benchmarkOutput, got " << arg << endl;
+            return 1;
+        }
+        string engine = arg.substr(0, eq);
+        auto times = ReadBenchmark(arg.substr(eq + 1));
+        vector<vector<double>> X;
+        vector<double> y;
+        for (auto& path : ListTests(testDir))
+        {
+            auto it = times.find(path.filename().string());
+            if (it == times.end())
+                continue;
+            Sudoku sd = ReadSudoku(path);
+            X.push_back(Analyze(sd).Vector());
+            y.push_back(log(max(it->second, 1e-6)));
+        }
+        if (X.empty())
+        {
+            cerr << "No tests of " << testDir << " in " << arg << endl;
+            return 1;
+        }
+        cout << engine;
+        for (double b : FitLeastSquares(X, y))
+            cout << ' ' << b;
+        cout << '\n';
+    }
+    return 0;
+}
+
+// Runs genetic.bin on 'sd' and returns true if it found the solution
+// The exit code of genetic.bin when its budget ran out
+const int GeneticBudgetExhausted = 2;
+
+// Solves 'sd' with genetic.bin within 'timeLimit' seconds. Returns the exit
+// code of the GA, or -1 if it was killed or did not print a full board.
+int RunGenetic(const string& genetic, const Sudoku& sd, SolutionGrid& grid,
+               double timeLimit)
+{
+    stringstream input;
+    input << sd;
+    Process proc(genetic, {genetic, "--time-limit", to_string(timeLimit)}, {});
+    fputs(input.str().c_str(), proc.StdIN());
+    proc.CloseStdIN();
+    int cells = 0, ch;
+    while ((ch = fgetc(proc.StdOUT())) != EOF)
+        if (ch >= '1' && ch <= '9' && cells < 81)
+            grid[cells++] = ch - '0';
+    int status = proc.Wait();
+    if (!WIFEXITED(status) || cells != 81)
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+bool KeepSolution(const SolutionGrid& grid, void* dest)
+{
+    *(SolutionGrid*)dest = grid;
+    return true;
+}
+
+// The time limit of the GA is its predicted time times the factor, but at
+// least the minimum
+const double GaTimeFactor = 4, GaMinSeconds = 2;
+
+// Sends every puzzle of 'testDir' to the engine with the lowest predicted
+// time: the trivial steps alone if they solve it, otherwise the DFS or the GA
+int Route(const string& modelFile, const string& testDir,
+          const string& genetic)
+{
+    map<string, vector<double>> model;
+    ifstream in(modelFile);
+    string line;
+    while (getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        stringstream fields(line);
+        string engine;
+        fields >> engine;
+        double b;
+        while (fields >> b)
+            model[engine].push_back(b);
+        if (engine != "dfs" && engine != "ga")
+        {
+            cerr << "Unknown engine " << engine << " in " << modelFile << endl;
+            return 1;
+        }
+    }
+    map<string, int> routed;
+    int failed = 0;
+    auto start = chrono::steady_clock::now();
+    for (auto& path : ListTests(testDir))
+    {
+        Sudoku puzzle = ReadSudoku(path), sd = puzzle;
+        Features f = Analyze(sd);
+        string engine = "propagate";
+        double predicted = 0;
+        if (f.AfterTrivial != 81)
+        {
+            predicted = INFINITY;
+            for (auto& [name, beta] : model)
+            {
+                auto x = f.Vector();
+                double logt = 0;
+                for (size_t i = 0; i < x.size() && i < beta.size(); i++)
+                    logt += x[i] * beta[i];
+                if (exp(logt) < predicted)
+                {
+                    predicted = exp(logt);
+                    engine = name;
+                }
+            }
+            // Without a model, DFS is the safe choice
+            if (model.empty())
+                engine = "dfs";
+        }
+        auto t0 = chrono::steady_clock::now();
+        SolutionGrid grid;
+        bool ok;
+        if (engine == "propagate")
+        {
+            for (int cell = 0; cell < 81; cell++)
+                grid[cell] = sd[cell / 9][cell % 9];
+            ok = true;
+        }
+        else if (engine == "dfs")
+            ok = EnumerateSolutions(sd, 1, KeepSolution, &grid) == 1;
+        else
+        {
+            // A mispredicted or unsolvable puzzle must not hold up the batch:
+            // the GA gets a few times its predicted time, then the DFS takes
+            // over
+            double limit = max(GaMinSeconds, GaTimeFactor * predicted);
+            int code = RunGenetic(genetic, sd, grid, limit);
+            ok = code == 0;
+            if (code == GeneticBudgetExhausted)
+            {
+                engine = "ga>dfs";
+                ok = EnumerateSolutions(sd, 1, KeepSolution, &grid) == 1;
+            }
+        }
+        ok = ok && VerifySolution(puzzle, grid);
+        double actual =
+            chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        cout << path.filename().string() << ' ' << engine << ' ' << predicted
+             << ' ' << actual << (ok ? "" : " FAILED") << '\n';
+        routed[engine]++;
+        failed += !ok;
+    }
+    double total =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Total " << total << " s;";
+    for (auto& [engine, cnt] : routed)
+        cout << ' ' << engine << ' ' << cnt;
+    cout << "; failed " << failed << endl;
+    return failed ? 1 : 0;
+}
+
+// Grades every puzzle given as a file or a directory of files with the
+// human techniques of grader.h
+int GradeAll(const vector<string>& paths)
+{
+    vector<filesystem::path> files;
+    for (const string& path : paths)
+    {
+        if (filesystem::is_directory(path))
+            for (auto& entry : ListTests(path))
+                files.push_back(entry);
+        else
+            files.push_back(path);
+    }
+    vector<SolutionGrid> puzzles;
+    for (auto& file : files)
+    {
+        Sudoku sd = ReadSudoku(file);
+        SolutionGrid g;
+        for (int cell = 0; cell < 81; cell++)
+            g[cell] = sd[cell / 9][cell % 9];
+        puzzles.push_back(g);
+    }
+    auto start = chrono::steady_clock::now();
+    vector<Grade> grades;
+    for (auto& g : puzzles)
+        grades.push_back(GradePuzzle(g));
+    double secs =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    map<Technique, int> histogram;
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        cout << files[i].filename().string() << ' '
+             << TechniqueName(grades[i].Hardest) << ' ' << grades[i].Steps
+             << '\n';
+        histogram[grades[i].Hardest]++;
+    }
+    if (files.size() > 1)
+    {
+        cout << "Graded " << files.size() << " puzzles in " << secs << " s\n";
+        for (auto [t, cnt] : histogram)
+            cout << TechniqueName(t) << ' ' << cnt << '\n';
+    }
+    return 0;
+}
+
 int main(int argc, char** argv)
 {
     if (argc <= 1)
     {
-        cout << "Usage: difficulty [--verbose] mytest.txt" << endl;
+        cout << "Usage: difficulty [--verbose] mytest.txt\n"
+                "       difficulty --features mytest.txt\n"
+                "       difficulty --grade (mytest.txt | testDir)...\n"
+                "       difficulty --calibrate testDir "
+                "engine=benchmarkOutput...\n"
+                "       difficulty --route model.txt testDir "
+                "[genetic=./genetic.bin]"
+             << endl;
         return 1;
     }
+    if (strcmp(argv[1], "--grade") == 0 && argc >= 3)
+        return GradeAll(vector<string>(argv + 2, argv + argc));
+    if (strcmp(argv[1], "--calibrate") == 0 && argc >= 4)
+        return Calibrate(argv[2], vector<string>(argv + 3, argv + argc));
+    if (strcmp(argv[1], "--route") == 0 && (argc == 4 || argc == 5))
+        return Route(argv[2], argv[3], argc == 5 ? argv[4] : "./genetic.bin");
     int fileindex = 1;
-    bool verbose = false;
+    bool verbose = false, features = false;
     if (strcmp(argv[fileindex], "--verbose") == 0)
     {
         fileindex++;
         verbose = true;
     }
-    ifstream fs(argv[fileindex]);
-    Sudoku sd;
-    fs >> sd;
-    fs.close();
-    int before = sd.NonzeroCount();
-    while (true)
+    else if (strcmp(argv[fileindex], "--features") == 0)
     {
-        bool ok = false;
-        for (int i = 0; i < 9; i++)
-            for (int j = 0; j < 9; j++)
-            {
-                if (sd[i][j])
-                    continue;
-                auto cell = sd.Cell(i, j);
-                bitset<10> avail = sd.Available(i, j);
-                if (avail.count() != 1)
-                    continue;
-                cell = avail._Find_first();
-                ok = true;
-            }
-        if (!ok)
-            break;
+        fileindex++;
+        features = true;
     }
-    int after = sd.NonzeroCount();
+    Sudoku sd = ReadSudoku(argv[fileindex]);
+    Features f = Analyze(sd);
     if (verbose)
     {
-        cout << "Initially:           " << before << endl;
-        cout << "After trivial steps: " << after << endl;
+        cout << "Initially:           " << f.Givens << endl;
+        cout << "After trivial steps: " << f.AfterTrivial << endl;
     }
-    cout << 81 - (before + 2 * after) / 3 << endl;
+    if (features)
+        cout << f.Givens << ' ' << f.AfterTrivial << ' ' << f.Rounds << ' '
+             << f.Candidates << ' ' << f.Bivalue << ' ';
+    cout << f.Score() << endl;
 }
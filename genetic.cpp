@@ -1,16 +1,133 @@
 #pragma GCC optimize("O2")
+#include "propagate.h"
+#include "solutioncache.h"
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <bitset>
+#include <csignal>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <ctime>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <set>
+#include <sys/time.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
 #include <vector>
 using namespace std;
 
+// Build with -DGENETIC_PROFILE to count events and measure the time spent in
+// the hot paths; the profile is printed to stderr at exit. Without the macro
+// PROFILE_SCOPE and PROFILE_COUNT expand to nothing.
+#ifdef GENETIC_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// The list of scoped timers
+#define PROFILE_TIMERS(X)                                                      \
+    X(Crossover) X(Mutate) X(KillExcess) X(SamplerBuild) X(SetInsert)         \
+        X(Restart) X(ExactSearch)
+// The list of event counters
+#define PROFILE_COUNTERS(X)                                                    \
+    X(MutationsAttempted) X(MutationsAccepted) X(OffspringInserted)            \
+        X(DuplicatesRejected) X(Restarts)
+
+class Profiler
+{
+public:
+#define PROFILE_ENUM(name) name,
+    enum Timer
+    {
+        PROFILE_TIMERS(PROFILE_ENUM) TimerCount
+    };
+    enum Counter
+    {
+        PROFILE_COUNTERS(PROFILE_ENUM) CounterCount
+    };
+#undef PROFILE_ENUM
+
+    // Ticks of the time stamp counter (or nanoseconds without one)
+    static unsigned long long Ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(
+                   chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    unsigned long long timerTicks[TimerCount]{}, timerCalls[TimerCount]{};
+    // Counters are incremented from the worker threads too
+    atomic<unsigned long long> counters[CounterCount]{};
+
+private:
+    // Used to convert ticks into seconds at exit
+    unsigned long long startTicks = Ticks();
+    chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
+
+public:
+    ~Profiler()
+    {
+        chrono::duration<double> elapsed =
+            chrono::steady_clock::now() - startTime;
+        double secPerTick = elapsed.count() / (Ticks() - startTicks);
+        const char* timerNames[]{
+#define PROFILE_NAME(name) #name,
+            PROFILE_TIMERS(PROFILE_NAME)};
+        const char* counterNames[]{PROFILE_COUNTERS(PROFILE_NAME)};
+#undef PROFILE_NAME
+        fprintf(stderr, "--Profile-- (total %.3f s)\n", elapsed.count());
+        for (int i = 0; i < TimerCount; i++)
+            fprintf(stderr, "%-20s %10.3f ms %12llu calls\n", timerNames[i],
+                    timerTicks[i] * secPerTick * 1000, timerCalls[i]);
+        for (int i = 0; i < CounterCount; i++)
+            fprintf(stderr, "%-20s %12llu\n", counterNames[i],
+                    counters[i].load());
+    }
+} profiler;
+
+// Adds the time spent in the enclosing scope to a timer
+class ScopedTimer
+{
+    Profiler::Timer timer;
+    unsigned long long start = Profiler::Ticks();
+
+public:
+    ScopedTimer(Profiler::Timer timer) : timer(timer)
+    {
+    }
+    ~ScopedTimer()
+    {
+        profiler.timerTicks[timer] += Profiler::Ticks() - start;
+        profiler.timerCalls[timer]++;
+    }
+};
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name)                                                    \
+    ScopedTimer PROFILE_CONCAT(profileTimer, __LINE__)(Profiler::name)
+#define PROFILE_COUNT(name, n)                                                 \
+    profiler.counters[Profiler::name].fetch_add((n), memory_order_relaxed)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(name, n)
+#endif
+
 // A data structure that efficiently maintains the counts of digits in a single
 // row, column, or block
 class DigitCounter
@@ -641,11 +758,67 @@ istream& operator>>(istream& in, Sudoku& s)
     return in;
 }
 
+// xoshiro256**: a fast generator with a 32-byte state. Every thread has its
+// own (see WorkerPool), so offspring can be generated in parallel.
+class Rng
+{
+    uint64_t state[4];
+    static uint64_t Rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    // Expand a 64-bit seed into the state with splitmix64
+    void Seed(uint64_t seed)
+    {
+        for (uint64_t& s : state)
+        {
+            uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            s = z ^ (z >> 31);
+        }
+    }
+    // The state can be saved and restored (see Snapshot)
+    void GetState(uint64_t out[4]) const
+    {
+        copy(state, state + 4, out);
+    }
+    void SetState(const uint64_t in[4])
+    {
+        copy(in, in + 4, state);
+    }
+    uint64_t Next()
+    {
+        uint64_t res = Rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotl(state[3], 45);
+        return res;
+    }
+};
+
+thread_local Rng rng;
+
+// The largest value returned by Random()
+constexpr int RandomMax = 0x7FFFFFFF;
+
+// A replacement for rand() that uses the generator of the current thread
+inline int Random()
+{
+    return rng.Next() >> 33;
+}
+
 // Returns the index of a random bit that is set to 1
 template <int Size> int ChooseBit(bitset<Size> avail)
 {
     int n = avail.count();
-    n = rand() % n;
+    n = Random() % n;
     size_t cur = avail._Find_first();
     for (; n; --n)
         cur = avail._Find_next(cur);
@@ -696,10 +869,10 @@ private:
     // only randint[1, 8] integers are shuffled ('no').
     static void RandomMutationIndices(int& no, int inds[9])
     {
-        no = rand() % 8 + 1;
+        no = Random() % 8 + 1;
         iota(inds, inds + 9, 0);
         for (int i = 0; i < no; i++)
-            swap(inds[i], inds[i + rand() % (9 - i)]);
+            swap(inds[i], inds[i + Random() % (9 - i)]);
     }
 
 public:
@@ -734,8 +907,8 @@ public:
         auto empty = AllEmptyCoords();
         if (empty.empty())
             return false;
-        pair<int, int> p = empty[rand() % empty.size()];
-        field.Cell(p.first, p.second) = rand() % 9 + 1;
+        pair<int, int> p = empty[Random() % empty.size()];
+        field.Cell(p.first, p.second) = Random() % 9 + 1;
         return true;
     }
     // Erase a digit in a non-initial cell
@@ -744,7 +917,7 @@ public:
         auto nonempty = AllNonInitialFilledCoords();
         if (nonempty.empty())
             return false;
-        auto p = nonempty[rand() % nonempty.size()];
+        auto p = nonempty[Random() % nonempty.size()];
         field.Cell(p.first, p.second) = 0;
         return true;
     }
@@ -754,11 +927,11 @@ public:
         auto nonempty = AllNonInitialFilledCoords();
         if (nonempty.empty())
             return false;
-        auto p = nonempty[rand() % nonempty.size()];
+        auto p = nonempty[Random() % nonempty.size()];
         auto cell = field.Cell(p.first, p.second);
         int prev = cell;
         // Choose a different digit
-        int nw = rand() % 8 + 1;
+        int nw = Random() % 8 + 1;
         nw += nw >= prev;
         cell = nw;
         return true;
@@ -773,8 +946,8 @@ public:
         int n = swappable.size();
         if (n < 2)
             return false;
-        int a = rand() % n;
-        int b = rand() % (n - 1);
+        int a = Random() % n;
+        int b = Random() % (n - 1);
         b += b >= a;
         auto pa = swappable[a];
         auto pb = swappable[b];
@@ -790,7 +963,7 @@ public:
         iota(rows.begin(), rows.end(), 0);
         while (rows.size())
         {
-            int ind = rand() % rows.size();
+            int ind = Random() % rows.size();
             int row = rows[ind];
             vector<pair<int, int>> region(9);
             for (int i = 0; i < 9; i++)
@@ -809,7 +982,7 @@ public:
         iota(cols.begin(), cols.end(), 0);
         while (cols.size())
         {
-            int ind = rand() % cols.size();
+            int ind = Random() % cols.size();
             int col = cols[ind];
             vector<pair<int, int>> region(9);
             for (int i = 0; i < 9; i++)
@@ -828,7 +1001,7 @@ public:
         iota(blocks.begin(), blocks.end(), 0);
         while (blocks.size())
         {
-            int ind = rand() % blocks.size();
+            int ind = Random() % blocks.size();
             int block = blocks[ind];
             vector<pair<int, int>> region;
             int xstart, xend, ystart, yend;
@@ -850,8 +1023,8 @@ public:
         // The code below tries to swap digits in other kinds of regions.
         // It has been left unused to leave the blocks consistent.
         vector<int> modes{0, 1, 2};
-        swap(modes[0], modes[rand() % 3]);
-        swap(modes[1], modes[rand() % 2 + 1]);
+        swap(modes[0], modes[Random() % 3]);
+        swap(modes[1], modes[Random() % 2 + 1]);
         for (int mode : modes)
             switch (mode)
             {
@@ -875,13 +1048,15 @@ public:
     {
         // All mutations are swaps within one block. All code after 'return;'
         // is ignored.
-        MutateSwapInBlock();
+        [[maybe_unused]] bool accepted = MutateSwapInBlock();
+        PROFILE_COUNT(MutationsAttempted, 1);
+        PROFILE_COUNT(MutationsAccepted, accepted);
         return;
         // The following code randomly chooses one way to mutate the chromosome.
         int modes[]{0, 1, 2, 3}; // grow, remove, change, swap
         for (int i = 0; i < sizeof(modes) / sizeof(modes[0]); i++)
             swap(modes[i],
-                 modes[rand() % (sizeof(modes) / sizeof(int) - i) + i]);
+                 modes[Random() % (sizeof(modes) / sizeof(int) - i) + i]);
         for (int mode : modes)
             switch (mode)
             {
@@ -949,7 +1124,7 @@ public:
         return;
         // The code below may crossover via columns or rows.
         // It has been left unused to keep the blocks valid.
-        switch (rand() % 3)
+        switch (Random() % 3)
         {
         case 0:
             RowCrossover(other);
@@ -964,94 +1139,124 @@ public:
     }
 };
 
-// A segment tree that samples several *distinct* elements according to weights
-class FitSampler
+// Both samplers take integer weights and keep their buffers between Build()
+// calls, so rebuilding them every generation does not allocate.
+
+// Samples indices with replacement in O(1) (Vose's alias method)
+class AliasSampler
 {
-    // The node of the binary tree
-    struct Node
-    {
-        // The segment is [l, r)
-        int l, r;
-        // The sum of weights on the segment
-        int sum;
-        void Init(int i, int val)
-        {
-            l = i;
-            r = i + 1;
-            sum = val;
-        }
-        void Recalc(Node& left, Node& right)
+    // Column i is taken with 'threshold[i]' chances out of 'total',
+    // otherwise its alias is taken
+    vector<long long> threshold;
+    vector<int> alias;
+    vector<int> small, large;
+    long long total = 0;
+
+public:
+    // Build the table in O(n)
+    void Build(const vector<int>& weights)
+    {
+        PROFILE_SCOPE(SamplerBuild);
+        int n = weights.size();
+        threshold.resize(n);
+        alias.resize(n);
+        small.clear();
+        large.clear();
+        total = accumulate(weights.begin(), weights.end(), 0LL);
+        if (!total)
+            return;
+        // Scale the weights so that the average column is exactly 'total'
+        for (int i = 0; i < n; i++)
         {
-            sum = left.sum + right.sum;
+            threshold[i] = (long long)weights[i] * n;
+            alias[i] = i;
+            (threshold[i] < total ? small : large).push_back(i);
         }
-        void Merge(Node& left, Node& right)
+        while (!small.empty() && !large.empty())
         {
-            l = left.l;
-            r = right.r;
-            Recalc(left, right);
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            alias[s] = l;
+            // The large column gives away what the small one lacks
+            threshold[l] -= total - threshold[s];
+            if (threshold[l] < total)
+            {
+                large.pop_back();
+                small.push_back(l);
+            }
         }
-    };
-    // The binary tree is indexed s.t. node i has children i*2+1 and i*2+2
-    vector<Node> st;
-    // The first index of the row of leaves
-    int start;
+        // The leftovers are full columns (up to rounding)
+        for (int i : small)
+            threshold[i] = total;
+        for (int i : large)
+            threshold[i] = total;
+    }
+    // Returns a random index; -1 if all weights are 0
+    int Sample() const
+    {
+        if (!total)
+            return -1;
+        int col = Random() % threshold.size();
+        long long coin =
+            ((long long)Random() * (RandomMax + 1LL) + Random()) % total;
+        return coin < threshold[col] ? col : alias[col];
+    }
+};
+
+// Samples *distinct* indices (without replacement) in O(log n) with an
+// implicit Fenwick tree
+class FenwickSampler
+{
+    // tree[i] (1-indexed) is the sum of the weights on (i - lowbit(i), i]
+    vector<int> tree;
+    vector<int> weights;
+    int n = 0;
+    // The highest power of 2 that is <= n
+    int topStep = 0;
+    long long total = 0;
 
 public:
-    // Fitnesses are weights. They make the leaves of the tree.
-    // The nodes above store the sum of their children's weights.
-    FitSampler(const vector<int>& fitnesses)
-    {
-        int n = fitnesses.size();
-        int sz = n & -n;
-        while (sz < n)
-            sz <<= 1;
-        st.resize(sz * 2 - 1);
-        start = sz - 1;
-        for (int i = 0; i < sz; i++)
+    // Build the tree in place in O(n)
+    void Build(const vector<int>& w)
+    {
+        PROFILE_SCOPE(SamplerBuild);
+        n = w.size();
+        weights = w;
+        tree.resize(n + 1);
+        tree[0] = 0;
+        copy(w.begin(), w.end(), tree.begin() + 1);
+        for (int i = 1; i <= n; i++)
         {
-            Node& nd = st[start + i];
-            nd.Init(i, i < n ? fitnesses[i] : 0);
-        }
-        for (int i = start - 1; i >= 0; i--)
-            st[i].Merge(st[i * 2 + 1], st[i * 2 + 2]);
-    }
-    // Change the weight of leaf 'ind' to 'val' in O(log n)
-    void SetWeight(int ind, int val)
-    {
-        ind += start;
-        // We are going to be adding the new value of 'val' to the nodes
-        val -= st[ind].sum;
-        st[ind].sum += val;
-        // Ascent to the root updates the sums on the containing segments
-        while (ind != 0)
-        {
-            ind = (ind - 1) / 2;
-            st[ind].sum += val;
+            int parent = i + (i & -i);
+            if (parent <= n)
+                tree[parent] += tree[i];
         }
+        total = accumulate(w.begin(), w.end(), 0LL);
+        topStep = 1;
+        while (topStep * 2 <= n)
+            topStep *= 2;
     }
-    // Returns a randomly chosen index and sets its weight to 0
+    // Returns a randomly chosen index and sets its weight to 0; -1 if nothing
+    // is left
     int Sample()
     {
-        // If nothing is left
-        if (st[0].sum == 0)
+        if (total <= 0)
             return -1;
-        int ind = rand() % st[0].sum;
-        // We start the segment tree descent
-        int cur = 0;
-        while (cur < start)
-        {
-            cur = cur * 2 + 1;
-            if (ind >= st[cur].sum)
+        long long rnd = Random() % total;
+        // Descend the implicit tree: find the first prefix sum > rnd
+        int pos = 0;
+        for (int step = topStep; step; step >>= 1)
+            if (pos + step <= n && tree[pos + step] <= rnd)
             {
-                ind -= st[cur].sum;
-                cur++;
+                pos += step;
+                rnd -= tree[pos];
             }
-        }
-        // Convert from tree indices to normal indices
-        cur -= start;
-        // 'Remove' the leaf
-        SetWeight(cur, 0);
-        return cur;
+        int w = weights[pos];
+        weights[pos] = 0;
+        total -= w;
+        for (int i = pos + 1; i <= n; i += i & -i)
+            tree[i] -= w;
+        return pos;
     }
 };
 
@@ -1070,6 +1275,173 @@ public:
     }
 };
 
+// The time spent in the steps of evolution, in microseconds
+struct StepTimes
+{
+    float Crossover = 0, Mutate = 0, KillExcess = 0;
+};
+
+// The statistics of one generation (see Telemetry). All fields are 4 bytes
+// wide, so the binary record has no padding.
+struct GenerationRecord
+{
+    int Generation;
+    int Best, Min;
+    float Mean;
+    // The number of chromosomes with the best fitness
+    int CountAtBest;
+    // The average fraction of cells that differ from the best chromosome
+    float Diversity;
+    int Restarts;
+    StepTimes Times;
+};
+
+// Streams one GenerationRecord per generation into a file descriptor, either
+// as raw binary records or as CSV lines. The records are buffered and
+// written in batches, so the evolution loop rarely makes a syscall.
+class Telemetry
+{
+    int fd;
+    bool binary;
+    string buf;
+    static constexpr size_t FlushSize = 1 << 16;
+
+public:
+    Telemetry(int fd, bool binary) : fd(fd), binary(binary)
+    {
+        if (!binary)
+            buf = "generation,best,min,mean,count_at_best,diversity,restarts,"
+                  "crossover_us,mutate_us,kill_excess_us\n";
+    }
+    void Write(const GenerationRecord& rec)
+    {
+        if (binary)
+            buf.append((const char*)&rec, sizeof(rec));
+        else
+        {
+            char line[256];
+            int len = snprintf(
+                line, sizeof(line), "%d,%d,%d,%.3f,%d,%.4f,%d,%.1f,%.1f,%.1f\n",
+                rec.Generation, rec.Best, rec.Min, rec.Mean, rec.CountAtBest,
+                rec.Diversity, rec.Restarts, rec.Times.Crossover,
+                rec.Times.Mutate, rec.Times.KillExcess);
+            buf.append(line, len);
+        }
+        if (buf.size() >= FlushSize)
+            Flush();
+    }
+    void Flush()
+    {
+        const char* data = buf.data();
+        size_t left = buf.size();
+        while (left)
+        {
+            ssize_t written = write(fd, data, left);
+            if (written <= 0)
+                break;
+            data += written;
+            left -= written;
+        }
+        buf.clear();
+    }
+    ~Telemetry()
+    {
+        Flush();
+    }
+};
+
+// A fixed set of threads that run the same job together; the calling thread
+// is worker 0. Each thread seeds its own generator (see Rng).
+class WorkerPool
+{
+    vector<thread> threads;
+    mutex m;
+    condition_variable start, done;
+    const function<void(int worker)>* job = nullptr;
+    // Incremented for every job, so that a worker never runs one twice
+    unsigned long long epoch = 0;
+    int busy = 0;
+    bool stop = false;
+
+    void Loop(int worker, uint64_t seed)
+    {
+        rng.Seed(seed);
+        unsigned long long seen = 0;
+        unique_lock<mutex> lock(m);
+        while (true)
+        {
+            start.wait(lock, [&] { return stop || epoch != seen; });
+            if (stop)
+                return;
+            seen = epoch;
+            lock.unlock();
+            (*job)(worker);
+            lock.lock();
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+
+public:
+    WorkerPool(int count)
+    {
+        for (int i = 1; i < count; i++)
+            threads.emplace_back(&WorkerPool::Loop, this, i, rng.Next());
+    }
+    int Size() const
+    {
+        return threads.size() + 1;
+    }
+    // Runs f(worker) on every worker and waits for all of them
+    void Run(const function<void(int worker)>& f)
+    {
+        {
+            lock_guard<mutex> lock(m);
+            job = &f;
+            busy = threads.size();
+            epoch++;
+        }
+        start.notify_all();
+        f(0);
+        unique_lock<mutex> lock(m);
+        done.wait(lock, [&] { return busy == 0; });
+    }
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> lock(m);
+            stop = true;
+        }
+        start.notify_all();
+        for (auto& t : threads)
+            t.join();
+    }
+};
+
+// How the parents for mutations and crossovers are chosen
+enum class Selection
+{
+    // Fitness-proportional (see AliasSampler and FenwickSampler)
+    Roulette,
+    // The best of k uniformly chosen chromosomes
+    Tournament,
+    // Stochastic universal sampling: equally spaced pointers over the
+    // fitness-proportional wheel, placed in one pass
+    SUS
+};
+
+// The tunable parts of Population
+struct PopulationConfig
+{
+    Selection selection = Selection::Roulette;
+    int tournamentSize = 2;
+    // If set, the offspring of a generation are created on all of its
+    // threads and inserted in one batch
+    WorkerPool* workers = nullptr;
+    // Cull near-duplicates more eagerly (see Population::AddNichePenalty)
+    bool niching = false;
+};
+
 // This data structure contains a set of Chromosomes and performs mutations,
 // crossovers, and 'natural selection'
 class Population
@@ -1078,17 +1450,208 @@ class Population
     int n;
     // The population of chromosomes
     set<Chromosome, FitnessComparator> pop;
+    // Buffers reused between generations: the weights of the chromosomes,
+    // their iterators in the set, and the samplers
+    vector<int> fits;
+    vector<set<Chromosome>::iterator> iters;
+    AliasSampler mutationSampler;
+    FenwickSampler crossoverSampler, killSampler;
+    vector<int> picks;
+    PopulationConfig config;
+    // The crossover couples (indices into 'iters')
+    vector<pair<int, int>> couples;
+    // Offspring created by each worker, and all of them together
+    vector<vector<Chromosome>> offspring;
+    vector<Chromosome> merged;
+    // Niching: the block keys of every chromosome and how often each occurs
+    vector<uint64_t> blockKeys;
+    unordered_map<uint64_t, int> nicheCounts;
+
+    // The extra culling weight per block shared with the average chromosome
+    static constexpr int NichePenalty =
+        (Chromosome::MaxFitness - Chromosome::MinFitness) / 9;
+
+    // Identifies the contents of a block: 9 decimal digits and the block index
+    static uint64_t BlockKey(const Sudoku& field, int blk)
+    {
+        int xstart, xend, ystart, yend;
+        Sudoku::Block(blk, xstart, xend, ystart, yend);
+        uint64_t key = blk;
+        for (int i = ystart; i < yend; i++)
+            for (int j = xstart; j < xend; j++)
+                key = key * 10 + field[i][j];
+        return key;
+    }
+
+    // Raise the culling weights in 'fits' (from 'first' on) of chromosomes
+    // that have many blocks in common with the rest of the population.
+    // Summed over all other chromosomes, the shared blocks are
+    // 9 - (the number of differing blocks), so this penalizes crowds of
+    // near-copies in O(9n) instead of comparing all pairs.
+    void AddNichePenalty(int first)
+    {
+        int sz = iters.size();
+        if (sz < 2)
+            return;
+        blockKeys.resize(sz * 9);
+        nicheCounts.clear();
+        for (int i = 0; i < sz; i++)
+            for (int blk = 0; blk < 9; blk++)
+            {
+                uint64_t key = BlockKey(iters[i]->Field(), blk);
+                blockKeys[i * 9 + blk] = key;
+                nicheCounts[key]++;
+            }
+        for (int i = first; i < sz; i++)
+        {
+            long long shared = 0;
+            for (int blk = 0; blk < 9; blk++)
+                shared += nicheCounts[blockKeys[i * 9 + blk]] - 1;
+            fits[i] += NichePenalty * shared / (sz - 1);
+        }
+    }
+
+    // k-tournament over 'iters'. The set is ordered by decreasing fitness,
+    // so the winner is simply the smallest of the k indices.
+    int TournamentPick() const
+    {
+        int sz = iters.size(), best = sz - 1;
+        for (int i = 0; i < config.tournamentSize; i++)
+            best = min(best, Random() % sz);
+        return best;
+    }
+
+    // Replace 'picks' with 'count' indices chosen by stochastic universal
+    // sampling over the weights in 'fits', in random order
+    void SUSPicks(int count)
+    {
+        picks.clear();
+        long long total = accumulate(fits.begin(), fits.end(), 0LL);
+        if (!total || count <= 0)
+            return;
+        // The k-th pointer is at (offset + k * total) / count; everything is
+        // multiplied by 'count' to stay in integers
+        long long pointer = Random() % total;
+        long long cum = 0;
+        for (int i = 0; i < (int)fits.size() && (int)picks.size() < count;
+             i++)
+        {
+            cum += fits[i];
+            for (; pointer < cum * count && (int)picks.size() < count;
+                 pointer += total)
+                picks.push_back(i);
+        }
+        for (int i = (int)picks.size() - 1; i > 0; i--)
+            swap(picks[i], picks[Random() % (i + 1)]);
+    }
+
+    // Fill 'fits' and 'iters' for the chromosomes starting from 'first';
+    // 'weight' maps a fitness to a sampling weight
+    template <class Weight> void CollectWeights(int first, Weight weight)
+    {
+        int sz = pop.size();
+        fits.assign(sz, 0);
+        iters.resize(sz);
+        auto iter = pop.begin();
+        for (int i = 0; i < sz; i++, ++iter)
+        {
+            if (i >= first)
+                fits[i] = weight(iter->Fitness());
+            iters[i] = iter;
+        }
+    }
+
+    // Add an offspring; duplicates are discarded by the set
+    void Insert(const Chromosome& ch)
+    {
+        PROFILE_SCOPE(SetInsert);
+        [[maybe_unused]] bool inserted = pop.insert(ch).second;
+        PROFILE_COUNT(OffspringInserted, inserted);
+        PROFILE_COUNT(DuplicatesRejected, !inserted);
+    }
+
+    // Insert the offspring of all workers at once. Duplicates inside the
+    // batch are removed before touching the set.
+    void MergeOffspring()
+    {
+        PROFILE_SCOPE(SetInsert);
+        merged.clear();
+        for (auto& buf : offspring)
+        {
+            move(buf.begin(), buf.end(), back_inserter(merged));
+            buf.clear();
+        }
+        FitnessComparator cmp;
+        sort(merged.begin(), merged.end(), cmp);
+        merged.erase(unique(merged.begin(), merged.end(),
+                            [&](const Chromosome& a, const Chromosome& b) {
+                                return !cmp(a, b) && !cmp(b, a);
+                            }),
+                     merged.end());
+        [[maybe_unused]] size_t total = merged.size(), before = pop.size();
+        pop.insert(merged.begin(), merged.end());
+        PROFILE_COUNT(OffspringInserted, pop.size() - before);
+        PROFILE_COUNT(DuplicatesRejected, total - (pop.size() - before));
+    }
+
+    // Pick a chromosome to mutate. SUS takes the i-th of the prepared picks.
+    // Safe to call from the workers.
+    int MutationParent(int i) const
+    {
+        switch (config.selection)
+        {
+        case Selection::Roulette:
+            return mutationSampler.Sample();
+        case Selection::Tournament:
+            return TournamentPick();
+        case Selection::SUS:
+            return picks[i];
+        }
+        return -1;
+    }
+
+    // Create the mutants on all workers, then insert them in one batch.
+    // Duplicates may leave the population short, so repeat until the quota
+    // is met.
+    void MutateParallel(int minMutationCount, int mutationMax)
+    {
+        WorkerPool& workers = *config.workers;
+        offspring.resize(workers.Size());
+        while (true)
+        {
+            int need = max(minMutationCount, n - (int)pop.size());
+            if (need <= 0)
+                break;
+            minMutationCount = 0;
+            if (config.selection == Selection::SUS)
+                SUSPicks(need);
+            workers.Run([&](int worker) {
+                auto& buf = offspring[worker];
+                for (int i = worker; i < need; i += workers.Size())
+                {
+                    Chromosome mut = *iters[MutationParent(i)];
+                    for (int j = Random() % mutationMax + 1; j; --j)
+                        mut.Mutate();
+                    buf.push_back(mut);
+                }
+            });
+            MergeOffspring();
+        }
+    }
 
     // Returns true with a chance of 'chance' out of 1
     static bool TestChance(float chance)
     {
-        return rand() / (double)RAND_MAX < chance;
+        return Random() / (double)RandomMax < chance;
     }
 
 public:
     // Initialize the population: add n random fillings of the sudoku
-    Population(int n, const Sudoku& init) : n(n)
+    Population(int n, const Sudoku& init,
+               const PopulationConfig& config = PopulationConfig())
+        : n(n), config(config)
     {
+        this->config.tournamentSize = max(config.tournamentSize, 1);
         // Insert a random completion 'n' times. If some of those sudokus
         // are the same, the set<...> will discard the duplicates,
         // but we don't care
@@ -1115,37 +1678,50 @@ public:
         }
     }
 
+    // Restore a population from its members (see Snapshot)
+    Population(int n, const vector<Sudoku>& members,
+               const PopulationConfig& config = PopulationConfig())
+        : n(n), config(config)
+    {
+        this->config.tournamentSize = max(config.tournamentSize, 1);
+        for (const Sudoku& member : members)
+            pop.emplace(member);
+    }
+
     // Mutate at least 'minMutationCount' chromosomes, but keep going until we
     // reach the quota. Each chromosome mutates [1, mutationMax] times.
     // Choose more fit chromosomes in hopes for quick advancement.
     void Mutate(int minMutationCount, int mutationMax)
     {
-        int sz = pop.size();
-        vector<int> fits(sz);
-        vector<decltype(pop)::iterator> iters(sz);
-        auto iter = pop.begin();
-        const int FitnessRange =
-            Chromosome::MaxFitness - Chromosome::MinFitness;
-        for (int i = 0; i < sz; i++, ++iter)
+        PROFILE_SCOPE(Mutate);
+        CollectWeights(0, [](int fit) {
+            return (fit - Chromosome::MinFitness) / 3 + 1;
+        });
+        if (config.selection == Selection::Roulette)
+            mutationSampler.Build(fits);
+        if (config.workers)
         {
-            int& curfit = fits[i];
-            curfit = (iter->Fitness() - Chromosome::MinFitness) / 3 + 1;
-            iters[i] = iter;
+            MutateParallel(minMutationCount, mutationMax);
+            return;
         }
-        // Build a cumulative sum array
-        for (int i = 1; i < sz; i++)
-            fits[i] += fits[i - 1];
+        size_t nextPick = 0;
+        picks.clear();
         while (minMutationCount > 0 || pop.size() < n)
         {
-            // Pick a chromosome to mutate
-            int rnd = rand() % fits.back();
-            int ind = upper_bound(fits.begin(), fits.end(), rnd) - fits.begin();
-            auto iter = iters[ind];
+            // Pick a chromosome to mutate. SUS samples as many as we are
+            // going to need at least; duplicates may make us come back for
+            // more.
+            if (config.selection == Selection::SUS && nextPick == picks.size())
+            {
+                SUSPicks(max({minMutationCount, n - (int)pop.size(), 1}));
+                nextPick = 0;
+            }
+            auto iter = iters[MutationParent(nextPick++)];
             // The mutant
             Chromosome mut = *iter;
-            for (int i = rand() % mutationMax + 1; i; --i)
+            for (int i = Random() % mutationMax + 1; i; --i)
                 mut.Mutate();
-            pop.insert(mut);
+            Insert(mut);
             minMutationCount -= !!minMutationCount;
         }
     }
@@ -1154,72 +1730,92 @@ public:
     // according to the fitness, and another is picked at random.
     void Crossover(int noLuckyChromosomes, int childrenPerCouple)
     {
+        PROFILE_SCOPE(Crossover);
         int sz = pop.size();
         if (sz < 2)
             return;
         // For a chromosome i, fits[i] is its fitness, and iters[i] is its
         // iterator in the set.
-        vector<int> fits(sz);
-        vector<set<Chromosome>::iterator> iters(sz);
-        {
-            auto iter = pop.begin();
-            for (int i = 0; i < sz; i++, iter++)
-            {
-                // Each one gets bonus points (+(max - min) / 9)
-                fits[i] = iter->Fitness() - Chromosome::MinFitness +
-                          (Chromosome::MaxFitness - Chromosome::MinFitness) / 9;
-                iters[i] = iter;
-            }
-        }
-
-        FitSampler samp(fits);
+        // Each one gets bonus points (+(max - min) / 9)
+        CollectWeights(0, [](int fit) {
+            return fit - Chromosome::MinFitness +
+                   (Chromosome::MaxFitness - Chromosome::MinFitness) / 9;
+        });
+        if (config.selection == Selection::Roulette)
+            crossoverSampler.Build(fits);
+        else if (config.selection == Selection::SUS)
+            SUSPicks(noLuckyChromosomes);
+        couples.clear();
         for (int i = 0; i < noLuckyChromosomes; i++)
         {
-            // Pick a mother
-            int mother = samp.Sample();
+            // Pick a mother. Roulette picks distinct mothers.
+            int mother;
+            if (config.selection == Selection::Roulette)
+                mother = crossoverSampler.Sample();
+            else if (config.selection == Selection::Tournament)
+                mother = TournamentPick();
+            else
+                mother = i < (int)picks.size() ? picks[i] : -1;
             if (mother == -1)
                 break;
             // Pick a father randomly, but it must be a different chromosome
-            int father = rand() % (sz - 1);
+            int father = Random() % (sz - 1);
             father += father >= mother;
-            for (int j = 0; j < childrenPerCouple; j++)
+            couples.emplace_back(mother, father);
+        }
+        if (!config.workers)
+        {
+            for (auto [mother, father] : couples)
+                for (int j = 0; j < childrenPerCouple; j++)
+                {
+                    Chromosome child = *iters[mother];
+                    child.Crossover(*iters[father]);
+                    Insert(child);
+                }
+            return;
+        }
+        // Create all children on the workers, then insert them in one batch
+        WorkerPool& workers = *config.workers;
+        offspring.resize(workers.Size());
+        int total = couples.size() * childrenPerCouple;
+        workers.Run([&](int worker) {
+            auto& buf = offspring[worker];
+            for (int i = worker; i < total; i += workers.Size())
             {
+                auto [mother, father] = couples[i / childrenPerCouple];
                 Chromosome child = *iters[mother];
                 child.Crossover(*iters[father]);
-                pop.insert(child);
+                buf.push_back(child);
             }
-        }
+        });
+        MergeOffspring();
     }
 
     // Remove chromosomes until there are not more than 'n' left.
     // The 'elites' best chromosomes are immune.
     void KillExcess(int elites)
     {
+        PROFILE_SCOPE(KillExcess);
         int sz = pop.size();
         if (sz <= n || elites >= sz)
             return;
-        vector<int> fits(sz);
-        // The maximum fitness; the chromosomes with fitness 'mxFit' are immune
+        // The maximum fitness
         int mxFit = pop.begin()->Fitness();
-        {
-            auto iter = pop.begin();
-            advance(iter, elites);
-            // Chromosomes with low fitnesses are likely to be picked.
-            // The best chromosomes are given weight 0.
-            // For diversity, we give bonus chances to all chromosomes.
-            for (int i = elites; i < sz; i++, ++iter)
-            {
-                int& curfit = fits[i];
-                curfit = mxFit - iter->Fitness() +
-                         (Chromosome::MaxFitness - Chromosome::MinFitness) / 3;
-            }
-        }
-        FitSampler samp(fits);
+        // Chromosomes with low fitnesses are likely to be picked.
+        // The elites are given weight 0.
+        // For diversity, we give bonus chances to all chromosomes.
+        CollectWeights(elites, [mxFit](int fit) {
+            return mxFit - fit +
+                   (Chromosome::MaxFitness - Chromosome::MinFitness) / 3;
+        });
+        if (config.niching)
+            AddNichePenalty(elites);
+        killSampler.Build(fits);
         // We mark a chromosome i for death by setting excess[i] = true
         vector<bool> excess(sz);
         for (int i = sz - n; i; --i)
         {
-            int ind = samp.Sample();
+            int ind = killSampler.Sample();
             if (ind != -1)
                 excess[ind] = true;
         }
@@ -1242,13 +1838,52 @@ public:
         }
     }
 
-    // Do a cycle of evolution
+    // Do a cycle of evolution. If 'times' is given, the time spent in each
+    // step is added to it.
     void EvolutionStep(int noLuckyChromosomes, int childrenPerCouple,
-                       int elites, int minMutationCount, int mutationMax)
+                       int elites, int minMutationCount, int mutationMax,
+                       StepTimes* times = nullptr)
     {
+        if (!times)
+        {
+            Crossover(noLuckyChromosomes, childrenPerCouple);
+            Mutate(minMutationCount, mutationMax);
+            KillExcess(elites);
+            return;
+        }
+        using clock = chrono::steady_clock;
+        auto t0 = clock::now();
         Crossover(noLuckyChromosomes, childrenPerCouple);
+        auto t1 = clock::now();
         Mutate(minMutationCount, mutationMax);
+        auto t2 = clock::now();
         KillExcess(elites);
+        auto t3 = clock::now();
+        times->Crossover += chrono::duration<float, micro>(t1 - t0).count();
+        times->Mutate += chrono::duration<float, micro>(t2 - t1).count();
+        times->KillExcess += chrono::duration<float, micro>(t3 - t2).count();
+    }
+
+    // Fill in the fitness statistics of the current generation
+    void Summarize(GenerationRecord& rec) const
+    {
+        const Sudoku& best = pop.begin()->Field();
+        rec.Best = pop.begin()->Fitness();
+        rec.Min = pop.rbegin()->Fitness();
+        rec.CountAtBest = 0;
+        long long sum = 0, differing = 0;
+        for (const Chromosome& ch : pop)
+        {
+            int fit = ch.Fitness();
+            sum += fit;
+            rec.CountAtBest += fit == rec.Best;
+            const Sudoku& f = ch.Field();
+            for (int i = 0; i < 9; i++)
+                for (int j = 0; j < 9; j++)
+                    differing += f[i][j] != best[i][j];
+        }
+        rec.Mean = sum / (float)pop.size();
+        rec.Diversity = differing / (81.0f * pop.size());
     }
 
     // See all chromosomes
@@ -1264,11 +1899,161 @@ public:
     }
 };
 
+// The exact search of the hybrid mode (see --hybrid and SearchSolutions in
+// propagate.h). Fills the empty cells of 'field'. Returns false if the filled
+// cells conflict, there is no solution, or 'maxNodes' search nodes were not
+// enough; 'field' is left unchanged then.
+bool SolveExactly(Sudoku& field, long long maxNodes)
+{
+    PROFILE_SCOPE(ExactSearch);
+    SolutionGrid givens, solution;
+    for (int cell = 0; cell < 81; cell++)
+        givens[cell] = field[cell / 9][cell % 9];
+    auto keep = [](const SolutionGrid& grid, void* dest) {
+        *(SolutionGrid*)dest = grid;
+        return true;
+    };
+    if (!SearchSolutions(givens, 1, keep, &solution, nullptr, nullptr, nullptr,
+                         maxNodes))
+        return false;
+    for (int cell = 0; cell < 81; cell++)
+        field.Cell(cell / 9, cell % 9) = solution[cell];
+    return true;
+}
+
+// Everything needed to continue a run (see --checkpoint and --resume).
+// Only the digits are stored, two per byte; the digit counters and hashes
+// are rebuilt on load. A population of 500 takes about 20 KB.
+struct Snapshot
+{
+    static constexpr char Magic[8] = "GASNAP2";
+    static constexpr int PackedSize = 41;
+
+    Sudoku puzzle;
+    int generation = 0, patience = 0, restarts = 0, prevfit = 0;
+    uint64_t rngState[4]{};
+    // The best chromosome ever seen, which may be gone after a restart
+    Sudoku best;
+    vector<Sudoku> members;
+
+    static void Pack(const Sudoku& s, unsigned char* out)
+    {
+        memset(out, 0, PackedSize);
+        for (int i = 0; i < 81; i++)
+            out[i >> 1] |= s[i / 9][i % 9] << (i & 1 ? 4 : 0);
+    }
+    // Fill the non-initial cells of 'base' with the packed digits
+    static Sudoku Unpack(Sudoku base, const unsigned char* in)
+    {
+        for (int i = 0; i < 81; i++)
+            if (!base.Initial(i / 9, i % 9))
+                base.Cell(i / 9, i % 9) = in[i >> 1] >> (i & 1 ? 4 : 0) & 0xF;
+        return base;
+    }
+
+    // Write to a temporary file and rename it, so that an interrupted save
+    // never destroys the previous snapshot
+    bool Save(const string& filename) const
+    {
+        string buf(Magic, sizeof(Magic));
+        unsigned char packed[PackedSize];
+        Pack(puzzle, packed);
+        buf.append((const char*)packed, PackedSize);
+        int32_t counters[]{generation, patience, restarts, prevfit,
+                           (int32_t)members.size()};
+        buf.append((const char*)counters, sizeof(counters));
+        buf.append((const char*)rngState, sizeof(rngState));
+        Pack(best, packed);
+        buf.append((const char*)packed, PackedSize);
+        for (const Sudoku& member : members)
+        {
+            Pack(member, packed);
+            buf.append((const char*)packed, PackedSize);
+        }
+        string tmpname = filename + ".tmp";
+        FILE* f = fopen(tmpname.c_str(), "wb");
+        if (!f)
+            return false;
+        bool ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+        ok &= fclose(f) == 0;
+        return ok && rename(tmpname.c_str(), filename.c_str()) == 0;
+    }
+
+    // Fails unless the population has 1 to 'maxMembers' chromosomes
+    bool Load(const string& filename, int maxMembers)
+    {
+        FILE* f = fopen(filename.c_str(), "rb");
+        if (!f)
+            return false;
+        char magic[sizeof(Magic)];
+        unsigned char packed[PackedSize];
+        int32_t counters[5];
+        bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+                  memcmp(magic, Magic, sizeof(Magic)) == 0 &&
+                  fread(packed, PackedSize, 1, f) == 1 &&
+                  fread(counters, sizeof(counters), 1, f) == 1 &&
+                  fread(rngState, sizeof(rngState), 1, f) == 1 &&
+                  counters[4] >= 1 && counters[4] <= maxMembers;
+        if (ok)
+        {
+            puzzle = Unpack(Sudoku(), packed);
+            puzzle.FreezeAll();
+            ok = fread(packed, PackedSize, 1, f) == 1;
+        }
+        if (ok)
+        {
+            best = Unpack(puzzle, packed);
+            generation = counters[0];
+            patience = counters[1];
+            restarts = counters[2];
+            prevfit = counters[3];
+            members.clear();
+            for (int i = 0; i < counters[4] && ok; i++)
+            {
+                ok = fread(packed, PackedSize, 1, f) == 1;
+                if (ok)
+                    members.push_back(Unpack(puzzle, packed));
+            }
+        }
+        fclose(f);
+        return ok;
+    }
+};
+
+// Set by the signal handlers; checked once per generation
+volatile sig_atomic_t checkpointRequested = 0, stopRequested = 0;
+// Set by SIGALRM when the --time-limit runs out
+volatile sig_atomic_t timeExpired = 0;
+
+// The exit code when the budget ran out before the solution was found
+const int ExitBudgetExhausted = 2;
+
 int main(int argc, char** argv)
 {
     // For debugging
     bool verbose = false;
     bool report = false;
+    // The file descriptor for the per-generation telemetry, -1 if disabled
+    int telemetryFd = -1;
+    bool telemetryBinary = false;
+    PopulationConfig config;
+    // The number of threads that create offspring; 1 = no extra threads
+    int threads = 1;
+    // Where to save snapshots, how often (0 = only on signals), and where
+    // to resume from
+    string checkpointFile, resumeFile;
+    int checkpointEvery = 0;
+    // The budget: wall-clock seconds and generations (0 = unlimited)
+    double timeLimit = 0;
+    long long maxGenerations = 0;
+    // Hybrid mode: when 'patience' drops below this, let the exact solver
+    // finish the best chromosome (0 = disabled)
+    int hybridPatience = 0;
+    // The solution cache consulted before the GA starts (see solutioncache.h)
+    string cacheFile;
+    // Fix the cells that singles propagation fills as givens before seeding
+    // the population
+    bool propagate = true;
     for (int i = 1; i < argc; i++)
     {
         char* str = argv[i];
@@ -1276,16 +2061,132 @@ int main(int argc, char** argv)
             verbose = true;
         if (strcmp(str, "--report") == 0)
             report = true;
-    }
-    // Initialize rand()
-    srand(clock());
-    Sudoku sd;
-    cin >> sd;
+        if ((strcmp(str, "--telemetry") == 0 ||
+             strcmp(str, "--telemetry-binary") == 0) &&
+            i + 1 < argc)
+        {
+            telemetryBinary = strcmp(str, "--telemetry-binary") == 0;
+            telemetryFd = atoi(argv[++i]);
+        }
+        if (strcmp(str, "--selection") == 0 && i + 1 < argc)
+        {
+            char* mode = argv[++i];
+            if (strcmp(mode, "roulette") == 0)
+                config.selection = Selection::Roulette;
+            else if (strcmp(mode, "tournament") == 0)
+                config.selection = Selection::Tournament;
+            else if (strcmp(mode, "sus") == 0)
+                config.selection = Selection::SUS;
+            else
+            {
+                cerr << "Unknown selection: " << mode
+                     << " (expected roulette, tournament, or sus)" << endl;
+                return 1;
+            }
+        }
+        if (strcmp(str, "--tournament-size") == 0 && i + 1 < argc)
+            config.tournamentSize = atoi(argv[++i]);
+        if (strcmp(str, "--niching") == 0)
+            config.niching = true;
+        if (strcmp(str, "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        if (strcmp(str, "--checkpoint") == 0 && i + 1 < argc)
+            checkpointFile = argv[++i];
+        if (strcmp(str, "--checkpoint-every") == 0 && i + 1 < argc)
+            checkpointEvery = atoi(argv[++i]);
+        if (strcmp(str, "--resume") == 0 && i + 1 < argc)
+            resumeFile = argv[++i];
+        if (strcmp(str, "--time-limit") == 0 && i + 1 < argc)
+            timeLimit = atof(argv[++i]);
+        if (strcmp(str, "--max-generations") == 0 && i + 1 < argc)
+            maxGenerations = atoll(argv[++i]);
+        if (strcmp(str, "--hybrid") == 0 && i + 1 < argc)
+            hybridPatience = atoi(argv[++i]);
+        if (strcmp(str, "--cache") == 0 && i + 1 < argc)
+            cacheFile = argv[++i];
+        if (strcmp(str, "--no-propagation") == 0)
+            propagate = false;
+    }
+    unique_ptr<Telemetry> telemetry;
+    if (telemetryFd != -1)
+        telemetry = make_unique<Telemetry>(telemetryFd, telemetryBinary);
+    GenerationRecord record{};
+    // Initialize Random()
+    rng.Seed(chrono::steady_clock::now().time_since_epoch().count());
     // If for 'MaxPatience' iterations we won't see any improvements, we retry
     const int PopulationMax = 500, MaxPatience = 1000;
+    Snapshot snapshot;
+    if (!resumeFile.empty() && !snapshot.Load(resumeFile, PopulationMax))
+    {
+        cerr << "Cannot resume from " << resumeFile << endl;
+        return 1;
+    }
+    Sudoku sd;
+    if (resumeFile.empty())
+        cin >> sd;
+    else
+        sd = snapshot.puzzle;
+    // Skip the GA if the puzzle, or a symmetric variant of it, was solved
+    // before
+    unique_ptr<SolutionCache> cache;
+    unique_ptr<SolutionCache::Key> cacheKey;
+    if (!cacheFile.empty())
+    {
+        SolutionGrid puzzle, solution;
+        for (int cell = 0; cell < 81; cell++)
+            puzzle[cell] = sd[cell / 9][cell % 9];
+        try
+        {
+            cache = make_unique<SolutionCache>(cacheFile);
+            cacheKey = make_unique<SolutionCache::Key>(puzzle);
+            if (cache->Lookup(*cacheKey, solution))
+            {
+                Sudoku sol = sd;
+                for (int cell = 0; cell < 81; cell++)
+                    sol.Cell(cell / 9, cell % 9) = solution[cell];
+                if (verbose)
+                    cout << "Found in the cache\n";
+                cout << sol;
+                if (report)
+                    cout << "REPORT\nMax " << Chromosome::MaxFitness
+                         << "\nAverage " << Chromosome::MaxFitness << endl;
+                return 0;
+            }
+        }
+        catch (const exception& e)
+        {
+            cerr << "Cannot use the cache: " << e.what() << endl;
+            return 1;
+        }
+    }
+    if (propagate && resumeFile.empty())
+    {
+        SolutionGrid givens;
+        for (int cell = 0; cell < 81; cell++)
+            givens[cell] = sd[cell / 9][cell % 9];
+        Propagator p(givens);
+        // On a contradiction, let the GA run on the puzzle as it is
+        if (p.Propagate())
+        {
+            for (int cell = 0; cell < 81; cell++)
+                sd.Cell(cell / 9, cell % 9) = p.Value(cell);
+            sd.FreezeAll();
+            if (verbose)
+                cout << "Givens after propagation: " << p.Filled() << "\n";
+        }
+    }
     int patience = MaxPatience;
-    // Initialize the population
-    Population pop(PopulationMax, sd);
+    // Initialize the population. The workers are seeded from 'rng', so they
+    // do not continue the streams of the interrupted run.
+    unique_ptr<WorkerPool> workers;
+    if (threads > 1)
+    {
+        workers = make_unique<WorkerPool>(threads);
+        config.workers = workers.get();
+    }
+    Population pop = resumeFile.empty()
+                         ? Population(PopulationMax, sd, config)
+                         : Population(PopulationMax, snapshot.members, config);
     if (verbose)
         cout << "Initial: " << pop.Best().Fitness() << endl;
     Chromosome prevbest = Chromosome(sd);
@@ -1294,23 +2195,144 @@ int main(int argc, char** argv)
     int prevnbest = 0;
     int prevfit = prevbest.Fitness();
     int curfit = prevfit;
+    if (!resumeFile.empty())
+    {
+        rng.SetState(snapshot.rngState);
+        record.Generation = snapshot.generation;
+        record.Restarts = snapshot.restarts;
+        patience = snapshot.patience;
+        prevfit = snapshot.prevfit;
+        curfit = pop.Best().Fitness();
+    }
+    // The periodic snapshot of this generation already exists (or there was
+    // no evolution yet)
+    const auto resumedGeneration = record.Generation;
+    if (!checkpointFile.empty())
+    {
+        // SIGUSR1 saves a snapshot; SIGINT and SIGTERM save one and stop
+        signal(SIGUSR1, [](int) { checkpointRequested = 1; });
+        auto stop = [](int) {
+            checkpointRequested = 1;
+            stopRequested = 1;
+        };
+        signal(SIGINT, stop);
+        signal(SIGTERM, stop);
+    }
+    if (timeLimit > 0)
+    {
+        // A one-shot timer, so that the loop only has to check a flag
+        signal(SIGALRM, [](int) { timeExpired = 1; });
+        itimerval timer{};
+        timer.it_value.tv_sec = (time_t)timeLimit;
+        timer.it_value.tv_usec = (timeLimit - (time_t)timeLimit) * 1e6;
+        if (!timer.it_value.tv_sec && !timer.it_value.tv_usec)
+            timer.it_value.tv_usec = 1;
+        setitimer(ITIMER_REAL, &timer, nullptr);
+    }
+    // Restarts discard the population, so keep the best chromosome ever seen
+    Chromosome bestEver =
+        resumeFile.empty() ? pop.Best() : Chromosome(snapshot.best);
+    // Search budgets of the exact solver in the hybrid mode. The run with the
+    // original givens is deterministic, so it is only tried once.
+    const long long TentativeNodes = 100000, FallbackNodes = 5000000;
+    bool tentativeFailed = false, fallbackTried = false;
     // Repeat until we find the solution
     while (curfit != Chromosome::MaxFitness)
     {
+        if (!checkpointFile.empty() &&
+            (checkpointRequested ||
+             (checkpointEvery && record.Generation % checkpointEvery == 0 &&
+              record.Generation != resumedGeneration)))
+        {
+            checkpointRequested = 0;
+            snapshot.puzzle = sd;
+            snapshot.generation = record.Generation;
+            snapshot.patience = patience;
+            snapshot.restarts = record.Restarts;
+            snapshot.prevfit = prevfit;
+            snapshot.best = bestEver.Field();
+            rng.GetState(snapshot.rngState);
+            snapshot.members.clear();
+            for (const Chromosome& ch : pop.AllChromosomes())
+                snapshot.members.push_back(ch.Field());
+            if (!snapshot.Save(checkpointFile))
+                cerr << "Cannot save a snapshot to " << checkpointFile << endl;
+            if (stopRequested)
+            {
+                cerr << "Stopped at generation " << record.Generation
+                     << "; continue with --resume " << checkpointFile << endl;
+                return 130;
+            }
+        }
+        if (timeExpired ||
+            (maxGenerations && record.Generation >= maxGenerations))
+            break;
+        record.Times = StepTimes();
         pop.EvolutionStep(PopulationMax / 3, 4, PopulationMax / 5,
-                          PopulationMax, 5);
+                          PopulationMax, 5,
+                          telemetry ? &record.Times : nullptr);
+        record.Generation++;
+        if (telemetry)
+        {
+            pop.Summarize(record);
+            telemetry->Write(record);
+        }
         curfit = pop.Best().Fitness();
+        if (curfit > bestEver.Fitness())
+            bestEver = pop.Best();
         if (curfit == prevfit)
             patience--;
         else
             patience = MaxPatience;
+        if (hybridPatience && patience == hybridPatience - 1)
+        {
+            // Keep the digits that do not clash within their row and column
+            // as tentative givens and let the exact solver fill the rest
+            const Sudoku& best = pop.Best().Field();
+            Sudoku tentative = best;
+            for (int i = 0; i < 9; i++)
+                for (int j = 0; j < 9; j++)
+                {
+                    int digit = best[i][j];
+                    if (!best.Initial(i, j) &&
+                        (best.RowCounts(i).Get(digit) > 1 ||
+                         best.ColumnCounts(j).Get(digit) > 1))
+                        tentative.Cell(i, j) = 0;
+                }
+            tentativeFailed = !SolveExactly(tentative, TentativeNodes);
+            if (!tentativeFailed)
+            {
+                if (verbose)
+                    cout << "\n\nThe exact solver finished the best chromosome\n"
+                         << tentative;
+                bestEver = Chromosome(tentative);
+                break;
+            }
+        }
+        if (patience == 0 && tentativeFailed && !fallbackTried)
+        {
+            // The tentative givens were wrong; try the original ones alone
+            fallbackTried = true;
+            Sudoku plain = sd;
+            if (SolveExactly(plain, FallbackNodes))
+            {
+                if (verbose)
+                    cout << "\n\nThe exact solver solved the puzzle\n"
+                         << plain;
+                bestEver = Chromosome(plain);
+                break;
+            }
+        }
         if (patience == 0)
         {
             // Retry
             if (verbose)
                 cout << "Restarting..." << endl;
+            record.Restarts++;
             // Initialize everything again
-            pop = Population(PopulationMax, sd);
+            PROFILE_SCOPE(Restart);
+            PROFILE_COUNT(Restarts, 1);
+            pop = Population(PopulationMax, sd, config);
             prevbest = pop.Best();
             curfit = prevfit = prevbest.Fitness();
             patience = MaxPatience;
@@ -1322,7 +2344,7 @@ int main(int argc, char** argv)
         // "Verbose" section: output improvements
         auto best = pop.Best();
         int noBest = 0;
-        auto all = pop.AllChromosomes();
+        const auto& all = pop.AllChromosomes();
         auto iter = all.begin();
         for (; iter != all.end() && iter->Fitness() == best.Fitness();
              ++iter, noBest++)
@@ -1339,9 +2361,21 @@ int main(int argc, char** argv)
             prevnbest = noBest;
         }
     }
-    // If not in verbose, we have not seen the solution
-    if (!verbose)
-        cout << pop.Best().Field();
+    bool solved = bestEver.Fitness() == Chromosome::MaxFitness;
+    if (solved && cache)
+    {
+        SolutionGrid solution;
+        for (int cell = 0; cell < 81; cell++)
+            solution[cell] = bestEver.Field()[cell / 9][cell % 9];
+        cache->Store(*cacheKey, solution);
+    }
+    // If not in verbose, we have not seen the solution. If the budget ran
+    // out, output the best attempt and its fitness.
+    if (!verbose || !solved)
+        cout << bestEver.Field();
+    if (!solved)
+        cout << "Fitness " << bestEver.Fitness() << '/'
+             << Chromosome::MaxFitness << '\n';
     // Make a report on the last generation
     if (report)
     {
@@ -1353,4 +2387,5 @@ int main(int argc, char** argv)
             sm += ch.Fitness();
         cout << sm / (double)pop.AllChromosomes().size() << endl;
     }
+    return solved ? 0 : ExitBudgetExhausted;
 }
@@ -0,0 +1,256 @@
+#include "grader.h"
+#include "propagate.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+const char* TechniqueName(Technique t)
+{
+    static const char* names[]{
+        "None",        "NakedSingle",  "HiddenSingle", "LockedCandidates",
+        "NakedPair",   "HiddenPair",   "NakedTriple",  "HiddenTriple",
+        "XWing",       "Swordfish",    "Search",       "Invalid"};
+    return names[(int)t];
+}
+
+class Grader
+{
+    Propagator p;
+
+    uint16_t Cand(int cell) const
+    {
+        return p.Candidates(cell);
+    }
+    bool Eliminate(int cell, uint16_t mask)
+    {
+        return p.Eliminate(cell, mask);
+    }
+
+public:
+    Grade grade{};
+
+    explicit Grader(const SolutionGrid& puzzle) : p(puzzle)
+    {
+    }
+
+    bool Done() const
+    {
+        return p.Filled() == 81 || p.Contradiction();
+    }
+    bool Invalid() const
+    {
+        return p.Contradiction();
+    }
+
+    bool NakedSingles()
+    {
+        int placed = p.NakedSingles();
+        grade.StepsBy[(int)Technique::NakedSingle] += placed;
+        return placed;
+    }
+
+    bool HiddenSingles()
+    {
+        int placed = p.HiddenSingles();
+        grade.StepsBy[(int)Technique::HiddenSingle] += placed;
+        return placed;
+    }
+
+    // Pointing (a box's candidates for a digit lie in one line) and claiming
+    // (a line's candidates lie in one box)
+    bool LockedCandidates()
+    {
+        for (int box = 18; box < 27; box++)
+            for (int line = 0; line < 18; line++)
+            {
+                uint16_t inBoth = 0, boxOnly = 0, lineOnly = 0;
+                for (int cell : UnitCells[box])
+                {
+                    bool onLine = CellUnits[cell][line < 9 ? 0 : 1] == line;
+                    (onLine ? inBoth : boxOnly) |= Cand(cell);
+                }
+                if (!inBoth)
+                    continue;
+                for (int cell : UnitCells[line])
+                    if (CellUnits[cell][2] != box)
+                        lineOnly |= Cand(cell);
+                uint16_t pointing = inBoth & ~boxOnly & lineOnly;
+                uint16_t claiming = inBoth & ~lineOnly & boxOnly;
+                if (!pointing && !claiming)
+                    continue;
+                for (int cell : UnitCells[line])
+                    if (CellUnits[cell][2] != box)
+                        Eliminate(cell, pointing);
+                for (int cell : UnitCells[box])
+                    if (CellUnits[cell][line < 9 ? 0 : 1] != line)
+                        Eliminate(cell, claiming);
+                grade.StepsBy[(int)Technique::LockedCandidates]++;
+                return true;
+            }
+        return false;
+    }
+
+    // 'size' cells of a unit whose candidates together are 'size' digits:
+    // these digits can be removed from the rest of the unit
+    bool NakedSubset(int size, Technique t)
+    {
+        for (int u = 0; u < 27; u++)
+        {
+            uint8_t cells[9];
+            int n = 0;
+            for (int cell : UnitCells[u])
+                if (Cand(cell) && __builtin_popcount(Cand(cell)) <= size)
+                    cells[n++] = cell;
+            for (int pick = 0; pick < 1 << n; pick++)
+            {
+                if (__builtin_popcount(pick) != size)
+                    continue;
+                uint16_t digits = 0;
+                for (int i = 0; i < n; i++)
+                    if (pick >> i & 1)
+                        digits |= Cand(cells[i]);
+                if (__builtin_popcount(digits) != size)
+                    continue;
+                bool progress = false;
+                for (int cell : UnitCells[u])
+                {
+                    bool member = false;
+                    for (int i = 0; i < n; i++)
+                        member |= (pick >> i & 1) && cells[i] == cell;
+                    if (!member)
+                        progress |= Eliminate(cell, digits);
+                }
+                if (progress)
+                {
+                    grade.StepsBy[(int)t]++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // 'size' digits that can only go into the same 'size' cells of a unit:
+    // other candidates can be removed from these cells
+    bool HiddenSubset(int size, Technique t)
+    {
+        for (int u = 0; u < 27; u++)
+        {
+            // Where every digit can go, as a mask of positions in the unit
+            uint16_t where[10]{};
+            for (int i = 0; i < 9; i++)
+                for (uint16_t c = Cand(UnitCells[u][i]); c; c &= c - 1)
+                    where[__builtin_ctz(c)] |= 1 << i;
+            for (int pick = 0; pick < 1 << 9; pick++)
+            {
+                if (__builtin_popcount(pick) != size)
+                    continue;
+                uint16_t positions = 0, digits = 0;
+                bool usable = true;
+                for (int d = 1; d <= 9; d++)
+                    if (pick >> (d - 1) & 1)
+                    {
+                        usable &= where[d] != 0;
+                        positions |= where[d];
+                        digits |= 1 << d;
+                    }
+                if (!usable || __builtin_popcount(positions) != size)
+                    continue;
+                bool progress = false;
+                for (int i = 0; i < 9; i++)
+                    if (positions >> i & 1)
+                        progress |= Eliminate(UnitCells[u][i], ~digits & 0x3FE);
+                if (progress)
+                {
+                    grade.StepsBy[(int)t]++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // 'size' rows where a digit can only go into the same 'size' columns:
+    // the digit can be removed from these columns in other rows (and the
+    // same with rows and columns swapped)
+    bool Fish(int size, Technique t)
+    {
+        for (int d = 1; d <= 9; d++)
+            for (int base = 0; base < 2; base++)
+            {
+                // where[i] = the cover lines where the digit can go in base
+                // line i
+                uint16_t where[9];
+                for (int i = 0; i < 9; i++)
+                {
+                    where[i] = 0;
+                    for (int j = 0; j < 9; j++)
+                    {
+                        int cell = base ? j * 9 + i : i * 9 + j;
+                        if (Cand(cell) >> d & 1)
+                            where[i] |= 1 << j;
+                    }
+                }
+                for (int pick = 0; pick < 1 << 9; pick++)
+                {
+                    if (__builtin_popcount(pick) != size)
+                        continue;
+                    uint16_t cover = 0;
+                    bool usable = true;
+                    for (int i = 0; i < 9; i++)
+                        if (pick >> i & 1)
+                        {
+                            usable &= where[i] != 0;
+                            cover |= where[i];
+                        }
+                    if (!usable || __builtin_popcount(cover) != size)
+                        continue;
+                    bool progress = false;
+                    for (int i = 0; i < 9; i++)
+                        if (!(pick >> i & 1))
+                            for (int j = 0; j < 9; j++)
+                                if (cover >> j & 1)
+                                    progress |= Eliminate(
+                                        base ? j * 9 + i : i * 9 + j, 1 << d);
+                    if (progress)
+                    {
+                        grade.StepsBy[(int)t]++;
+                        return true;
+                    }
+                }
+            }
+        return false;
+    }
+};
+
+Grade GradePuzzle(const SolutionGrid& puzzle)
+{
+    Grader g(puzzle);
+    while (!g.Done())
+    {
+        // Always fall back to the cheapest technique after any progress
+        if (g.NakedSingles() || g.HiddenSingles() || g.LockedCandidates() ||
+            g.NakedSubset(2, Technique::NakedPair) ||
+            g.HiddenSubset(2, Technique::HiddenPair) ||
+            g.NakedSubset(3, Technique::NakedTriple) ||
+            g.HiddenSubset(3, Technique::HiddenTriple) ||
+            g.Fish(2, Technique::XWing) || g.Fish(3, Technique::Swordfish))
+            continue;
+        break;
+    }
+    Grade res = g.grade;
+    res.Hardest = Technique::None;
+    res.Steps = 0;
+    for (int t = 0; t < (int)Technique::Search; t++)
+    {
+        res.Steps += res.StepsBy[t];
+        if (res.StepsBy[t])
+            res.Hardest = (Technique)t;
+    }
+    if (g.Invalid())
+        res.Hardest = Technique::Invalid;
+    else if (!g.Done())
+        res.Hardest = Technique::Search;
+    return res;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "sudokusolve.h"
+
+// Human solving techniques, from the cheapest to the hardest
+enum class Technique
+{
+    None,
+    NakedSingle,
+    HiddenSingle,
+    LockedCandidates,
+    NakedPair,
+    HiddenPair,
+    NakedTriple,
+    HiddenTriple,
+    XWing,
+    Swordfish,
+    // The techniques above are not enough; the puzzle needs search
+    Search,
+    // The givens contradict each other or the techniques found that the
+    // puzzle has no solution
+    Invalid,
+    Count
+};
+
+const char* TechniqueName(Technique t);
+
+struct Grade
+{
+    // The hardest technique the solution needed
+    Technique Hardest;
+    // The total number of steps and the steps of every technique. A step is
+    // one placed digit or one application of an elimination technique.
+    int Steps;
+    int StepsBy[(int)Technique::Count];
+};
+
+// Solves 'puzzle' like a human would, always using the cheapest technique
+// that makes progress
+Grade GradePuzzle(const SolutionGrid& puzzle);
@@ -1,34 +1,138 @@
 #include "launcher.h"
+#include <algorithm>
+#include <cerrno>
 #include <csignal>
 #include <cstdio>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 using namespace std;
 
+// A null-terminated array of pointers to the strings, as execve expects
+static vector<char*> CStrings(const vector<string>& strs)
+{
+    vector<char*> res(strs.size() + 1);
+    for (size_t i = 0; i < strs.size(); i++)
+        res[i] = const_cast<char*>(strs[i].c_str());
+    return res;
+}
+
+// Creates the two pipes; both are closed in the child on exec
+static void OpenPipes(int tochild[2], int fromchild[2])
+{
+    if (pipe2(tochild, O_CLOEXEC))
+        throw system_error(errno, generic_category(), "pipe2");
+    if (pipe2(fromchild, O_CLOEXEC))
+    {
+        int err = errno;
+        close(tochild[0]);
+        close(tochild[1]);
+        throw system_error(err, generic_category(), "pipe2");
+    }
+}
+
+static void ClosePipes(int tochild[2], int fromchild[2])
+{
+    for (int i = 0; i < 2; i++)
+    {
+        close(tochild[i]);
+        close(fromchild[i]);
+    }
+}
+
 Process::Process(const string& filename, vector<string> argv,
                  vector<string> env, void (*doBeforeChild)(void* params),
                  void* doBeforeChildParams)
 {
     int _tochild[2];
     int _fromchild[2];
-    pipe(_tochild);
-    pipe(_fromchild);
+    OpenPipes(_tochild, _fromchild);
+    // The child reports the errno of a failed execve through this pipe.
+    // A successful execve closes it, so the parent reads EOF.
+    int _execerr[2];
+    if (pipe2(_execerr, O_CLOEXEC))
+    {
+        int err = errno;
+        ClosePipes(_tochild, _fromchild);
+        throw system_error(err, generic_category(), "pipe2");
+    }
+    // Allocate before forking: the child should only call async-signal-safe
+    // functions
+    vector<char*> _argv = CStrings(argv);
+    vector<char*> _env = CStrings(env);
     child = fork();
     if (!child)
     {
-        close(_tochild[1]);
-        close(_fromchild[0]);
         dup2(_tochild[0], STDIN_FILENO);
         dup2(_fromchild[1], STDOUT_FILENO);
         doBeforeChild(doBeforeChildParams);
-        vector<char*> _argv(argv.size() + 1);
-        for (size_t i = 0; i < argv.size(); i++)
-            _argv[i] = argv[i].data();
-        vector<char*> _env(env.size() + 1);
-        for (size_t i = 0; i < env.size(); i++)
-            _env[i] = env[i].data();
         execve(filename.c_str(), _argv.data(), _env.data());
+        int err = errno;
+        write(_execerr[1], &err, sizeof(err));
+        _exit(127);
+    }
+    int err = errno;
+    close(_execerr[1]);
+    if (child == -1)
+    {
+        close(_execerr[0]);
+        ClosePipes(_tochild, _fromchild);
+        throw system_error(err, generic_category(), "fork");
     }
+    ssize_t got;
+    do
+        got = read(_execerr[0], &err, sizeof(err));
+    while (got == -1 && errno == EINTR);
+    close(_execerr[0]);
+    if (got == sizeof(err))
+    {
+        waitpid(child, nullptr, 0);
+        ClosePipes(_tochild, _fromchild);
+        throw system_error(err, generic_category(), "execve " + filename);
+    }
+    Adopt(_tochild, _fromchild);
+}
+
+Process::Process(const string& filename, const vector<string>& argv,
+                 const vector<string>& env)
+{
+    int _tochild[2];
+    int _fromchild[2];
+    OpenPipes(_tochild, _fromchild);
+    // posix_spawn does not copy our page tables (glibc uses
+    // clone(CLONE_VM | CLONE_VFORK)) and reports execve errors itself
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, _tochild[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, _fromchild[1], STDOUT_FILENO);
+    // Ignored signals stay ignored across exec; SIGPIPE should not
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t sigdefault;
+    sigemptyset(&sigdefault);
+    sigaddset(&sigdefault, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attr, &sigdefault);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+    vector<char*> _argv = CStrings(argv);
+    vector<char*> _env = CStrings(env);
+    int err = posix_spawn(&child, filename.c_str(), &actions, &attr,
+                          _argv.data(), _env.data());
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err)
+    {
+        ClosePipes(_tochild, _fromchild);
+        throw system_error(err, generic_category(), "posix_spawn " + filename);
+    }
+    Adopt(_tochild, _fromchild);
+}
+
+void Process::Adopt(int _tochild[2], int _fromchild[2])
+{
     close(_tochild[0]);
     close(_fromchild[1]);
     tochild = _tochild[1];
@@ -37,12 +141,6 @@ Process::Process(const string& filename, vector<string> argv,
     childw = fdopen(tochild, "w");
 }
 
-Process::Process(const string& filename, const vector<string>& argv,
-                 const vector<string>& env)
-    : Process(filename, argv, env, [](void*) {}, 0)
-{
-}
-
 FILE* Process::StdIN() const
 {
     return childw;
@@ -58,12 +156,41 @@ pid_t Process::PID() const
     return child;
 }
 
+bool Process::Reap(int options)
+{
+    if (reaped)
+        return true;
+    rusage ru;
+    if (wait4(child, &status, options, &ru) != child)
+        return false;
+    reaped = terminated = true;
+    usage.UserTime = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6;
+    usage.SysTime = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+    usage.MaxRSS = ru.ru_maxrss;
+    usage.MinorFaults = ru.ru_minflt;
+    usage.MajorFaults = ru.ru_majflt;
+    usage.VolContextSwitches = ru.ru_nvcsw;
+    usage.InvolContextSwitches = ru.ru_nivcsw;
+    return true;
+}
+
 int Process::Wait()
 {
-    int stat;
-    waitpid(child, &stat, 0);
-    terminated = true;
-    return stat;
+    Reap(0);
+    return status;
+}
+
+bool Process::TryWait(int& stat)
+{
+    if (!Reap(WNOHANG))
+        return false;
+    stat = status;
+    return true;
+}
+
+const ResourceUsage& Process::Usage() const
+{
+    return usage;
 }
 
 void Process::Kill()
@@ -77,10 +204,128 @@ Process::~Process()
     CloseAll();
 }
 
+void Process::CloseStdIN()
+{
+    if (childw)
+        fclose(childw);
+    childw = nullptr;
+}
+
 void Process::CloseAll()
 {
-    fclose(childw);
+    // fclose also closes the underlying descriptors
+    CloseStdIN();
     fclose(childr);
-    close(tochild);
-    close(fromchild);
+}
+
+ProcessPool::ProcessPool(size_t maxRunning, double timeLimit,
+                         OutputSink sink, void* sinkParams)
+    : maxRunning(max<size_t>(maxRunning, 1)), timeLimit(timeLimit),
+      sink(sink), sinkParams(sinkParams)
+{
+    // A child that exits before reading its input must not kill us
+    signal(SIGPIPE, SIG_IGN);
+}
+
+size_t ProcessPool::Submit(const string& filename, vector<string> argv,
+                           vector<string> env, string input)
+{
+    pending.push_back({submitted, filename, move(argv), move(env),
+                       move(input)});
+    return submitted++;
+}
+
+void ProcessPool::LaunchPending()
+{
+    while (running.size() < maxRunning && !pending.empty())
+    {
+        Job& job = pending.front();
+        Running r;
+        r.proc = make_unique<Process>(job.filename, job.argv, job.env);
+        r.index = job.index;
+        r.start = chrono::steady_clock::now();
+        fputs(job.input.c_str(), r.proc->StdIN());
+        r.proc->CloseStdIN();
+        running.push_back(move(r));
+        pending.pop_front();
+    }
+}
+
+void ProcessPool::Finish(size_t ind, bool timedOut, PoolResult& res)
+{
+    Running& r = running[ind];
+    res.Job = r.index;
+    res.Status = r.proc->Wait();
+    res.TimedOut = timedOut;
+    res.Output = move(r.output);
+    chrono::duration<double> wall = chrono::steady_clock::now() - r.start;
+    res.Wall = wall.count();
+    res.Usage = r.proc->Usage();
+    swap(running[ind], running.back());
+    running.pop_back();
+}
+
+bool ProcessPool::Next(PoolResult& res)
+{
+    LaunchPending();
+    if (running.empty())
+        return false;
+    vector<pollfd> fds;
+    vector<size_t> owners;
+    while (true)
+    {
+        auto now = chrono::steady_clock::now();
+        // Milliseconds until the nearest deadline; -1 = wait indefinitely
+        int waitms = -1;
+        for (size_t i = 0; i < running.size(); i++)
+        {
+            Running& r = running[i];
+            int stat;
+            if (r.eof && r.proc->TryWait(stat))
+            {
+                Finish(i, false, res);
+                return true;
+            }
+            if (timeLimit > 0)
+            {
+                chrono::duration<double> left =
+                    r.start + chrono::duration<double>(timeLimit) - now;
+                if (left.count() <= 0)
+                {
+                    r.proc->Kill();
+                    Finish(i, true, res);
+                    return true;
+                }
+                int ms = left.count() * 1000 + 1;
+                waitms = waitms == -1 ? ms : min(waitms, ms);
+            }
+            // The child closed its stdout but has not exited yet
+            if (r.eof)
+                waitms = waitms == -1 ? 1 : min(waitms, 1);
+        }
+        fds.clear();
+        owners.clear();
+        for (size_t i = 0; i < running.size(); i++)
+            if (!running[i].eof)
+            {
+                fds.push_back({fileno(running[i].proc->StdOUT()), POLLIN, 0});
+                owners.push_back(i);
+            }
+        if (poll(fds.data(), fds.size(), waitms) <= 0)
+            continue;
+        for (size_t k = 0; k < fds.size(); k++)
+        {
+            if (!fds[k].revents)
+                continue;
+            Running& r = running[owners[k]];
+            char buf[16384];
+            ssize_t got = read(fds[k].fd, buf, sizeof(buf));
+            if (got > 0 && sink)
+                sink(r.index, buf, got, sinkParams);
+            else if (got > 0)
+                r.output.append(buf, got);
+            else if (got == 0 || errno != EINTR)
+                r.eof = true;
+        }
+    }
 }
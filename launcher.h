@@ -1,26 +1,125 @@
 #pragma once
+#include <chrono>
 #include <csignal>
+#include <deque>
+#include <memory>
 #include <string>
 #include <vector>
 
+// Resources consumed by a terminated child (collected with wait4)
+struct ResourceUsage
+{
+    // CPU time in seconds
+    double UserTime = 0, SysTime = 0;
+    // Peak resident set size in kilobytes
+    long MaxRSS = 0;
+    // Page faults that did not / did require I/O
+    long MinorFaults = 0, MajorFaults = 0;
+    // Voluntary (blocking) and involuntary (preempted) context switches
+    long VolContextSwitches = 0, InvolContextSwitches = 0;
+};
+
 class Process
 {
     pid_t child;
     int tochild, fromchild;
     FILE *childw, *childr;
     bool terminated = false;
+    // Set once the child has been collected by wait4
+    bool reaped = false;
+    int status = 0;
+    ResourceUsage usage;
     void CloseAll();
+    bool Reap(int options);
+    // Takes the parent's ends of the pipes
+    void Adopt(int tochild[2], int fromchild[2]);
 
 public:
+    // Launches with fork() to run 'doBeforeChild' in the child before
+    // execve. Throws std::system_error if the child could not be started.
     Process(const std::string& filename, std::vector<std::string> argv,
             std::vector<std::string> env, void (*doBeforeChild)(void* params),
             void* doBeforeChildParams);
+    // Launches with posix_spawn, which is much cheaper than fork() for a
+    // large parent. Throws std::system_error if the child could not be
+    // started.
     Process(const std::string& filename, const std::vector<std::string>& argv,
             const std::vector<std::string>& env);
     FILE* StdIN() const;
     FILE* StdOUT() const;
     pid_t PID() const;
     int Wait();
+    // Collects the child if it has terminated, never blocks
+    bool TryWait(int& status);
+    // Valid after Wait() or a successful TryWait()
+    const ResourceUsage& Usage() const;
+    // Sends EOF to the child
+    void CloseStdIN();
     void Kill();
     ~Process();
 };
+
+// The outcome of a job run by ProcessPool
+struct PoolResult
+{
+    // The index of the job in the order of Submit() calls
+    size_t Job;
+    // The status from wait4
+    int Status;
+    // True if the child was killed for exceeding the time limit
+    bool TimedOut;
+    // Everything the child wrote to its stdout (empty if the pool has a sink)
+    std::string Output;
+    // Seconds from the launch to the termination
+    double Wall;
+    ResourceUsage Usage;
+};
+
+// Receives the stdout of job 'job' chunk by chunk as it arrives. The data is
+// only valid during the call.
+typedef void (*OutputSink)(size_t job, const char* data, size_t len,
+                           void* params);
+
+// Keeps up to 'maxRunning' children in flight, feeds each one its input and
+// collects its stdout with poll(). Completions are returned by Next() in the
+// order they happen.
+class ProcessPool
+{
+    struct Job
+    {
+        size_t index;
+        std::string filename;
+        std::vector<std::string> argv, env;
+        std::string input;
+    };
+    struct Running
+    {
+        std::unique_ptr<Process> proc;
+        size_t index;
+        std::string output;
+        std::chrono::steady_clock::time_point start;
+        bool eof = false;
+    };
+    size_t maxRunning;
+    double timeLimit;
+    OutputSink sink;
+    void* sinkParams;
+    size_t submitted = 0;
+    std::deque<Job> pending;
+    std::vector<Running> running;
+    void LaunchPending();
+    void Finish(size_t ind, bool timedOut, PoolResult& res);
+
+public:
+    // 'timeLimit' is the wall-clock limit per child in seconds; 0 means none.
+    // If 'sink' is given, the output is streamed to it instead of being
+    // collected into PoolResult::Output.
+    ProcessPool(size_t maxRunning, double timeLimit = 0,
+                OutputSink sink = nullptr, void* sinkParams = nullptr);
+    // Queues a job and returns its index. The input is written to the child
+    // at once, so it should fit into the pipe buffer.
+    size_t Submit(const std::string& filename, std::vector<std::string> argv,
+                  std::vector<std::string> env, std::string input);
+    // Waits for some job to finish. Returns false if no jobs are left.
+    bool Next(PoolResult& res);
+};
@@ -0,0 +1,216 @@
+#include "bandsolve.h"
+#include "launcher.h"
+#include "sudoku.h"
+#include "sudokusolve.h"
+#include <chrono>
+#include <csignal>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <system_error>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// The state shared by all engines of a race
+struct Race
+{
+    Sudoku puzzle;
+    // Set once some engine has a verified solution; every engine stops then
+    atomic<bool> cancel{false};
+    mutex lock;
+    condition_variable changed;
+    int running = 0;
+    string winner;
+    // Set when an exact engine finished its search without finding anything
+    bool unsolvable = false;
+    SolutionGrid solution;
+    chrono::steady_clock::time_point start;
+    double wall = 0;
+    // The genetic islands that are still running, so that they can be killed
+    vector<Process*> islands;
+
+    // Accepts the solution of 'engine' if it is the first verified one
+    void Offer(const string& engine, const SolutionGrid& grid)
+    {
+        if (!VerifySolution(puzzle, grid))
+        {
+            cerr << engine << " returned a wrong solution" << endl;
+            return;
+        }
+        lock_guard<mutex> guard(lock);
+        if (!winner.empty())
+            return;
+        winner = engine;
+        solution = grid;
+        wall = chrono::duration<double>(chrono::steady_clock::now() - start)
+                   .count();
+        cancel = true;
+        for (Process* p : islands)
+            p->Kill();
+        changed.notify_all();
+    }
+    // An exact engine searched everything: there is no solution, so nobody
+    // can win
+    void NoSolution()
+    {
+        lock_guard<mutex> guard(lock);
+        unsolvable = true;
+        cancel = true;
+        for (Process* p : islands)
+            p->Kill();
+        changed.notify_all();
+    }
+    void Finished()
+    {
+        lock_guard<mutex> guard(lock);
+        running--;
+        changed.notify_all();
+    }
+};
+
+bool KeepSolution(const SolutionGrid& grid, void* dest)
+{
+    *(SolutionGrid*)dest = grid;
+    return true;
+}
+
+void RunExact(Race& race, const string& name)
+{
+    SolutionGrid grid;
+    long long found =
+        name == "bands"
+            ? EnumerateSolutionsBands(race.puzzle, 1, KeepSolution, &grid,
+                                      &race.cancel)
+            : EnumerateSolutions(race.puzzle, 1, KeepSolution, &grid, nullptr,
+                                 nullptr, &race.cancel);
+    if (found)
+        race.Offer(name, grid);
+    else if (!race.cancel)
+        race.NoSolution();
+    race.Finished();
+}
+
+// Runs one island of the genetic algorithm as a child process
+void RunIsland(Race& race, const string& name, const string& genetic,
+               vector<string> args)
+{
+    stringstream input;
+    input << race.puzzle;
+    args.insert(args.begin(), genetic);
+    try
+    {
+        Process proc(genetic, args, {});
+        {
+            lock_guard<mutex> guard(race.lock);
+            if (race.cancel)
+                proc.Kill();
+            race.islands.push_back(&proc);
+        }
+        // The island may have been killed already, then it is lost (SIGPIPE
+        // is ignored)
+        bool sent = fputs(input.str().c_str(), proc.StdIN()) != EOF &&
+                    fflush(proc.StdIN()) == 0;
+        proc.CloseStdIN();
+        string output;
+        char buf[4096];
+        size_t len;
+        while (sent && (len = fread(buf, 1, sizeof(buf), proc.StdOUT())) > 0)
+            output.append(buf, len);
+        // Nobody may kill the child once it is reaped: its PID can be reused
+        {
+            lock_guard<mutex> guard(race.lock);
+            erase(race.islands, &proc);
+        }
+        int status = proc.Wait();
+        // The GA prints the solved board and exits with 0
+        if (sent && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            SolutionGrid grid;
+            int cells = 0;
+            for (char ch : output)
+                if (ch >= '1' && ch <= '9' && cells < 81)
+                    grid[cells++] = ch - '0';
+            if (cells == 81)
+                race.Offer(name, grid);
+        }
+    }
+    catch (const system_error& e)
+    {
+        cerr << name << ": " << e.what() << endl;
+    }
+    race.Finished();
+}
+
+int main(int argc, char** argv)
+{
+    int islands = 2;
+    string genetic = "./genetic.bin";
+    // The budget of every island in seconds
+    string timeLimit = "60";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--islands") == 0 && i + 1 < argc)
+            islands = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--genetic") == 0 && i + 1 < argc)
+            genetic = argv[++i];
+        else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc)
+            timeLimit = argv[++i];
+        else
+        {
+            cout << "Usage: portfolio [--islands N=2] "
+                    "[--genetic path=./genetic.bin] "
+                    "[--time-limit seconds=60] < puzzle"
+                 << endl;
+            return 1;
+        }
+    }
+    // Writing the puzzle to an island that was already killed must not kill
+    // us
+    signal(SIGPIPE, SIG_IGN);
+    Race race;
+    cin >> race.puzzle;
+    race.start = chrono::steady_clock::now();
+    vector<thread> engines;
+    race.running = 2 + islands;
+    for (string name : {"dfs", "bands"})
+        engines.emplace_back(RunExact, ref(race), name);
+    // Islands differ in their selection so that they explore differently
+    const char* selections[]{"roulette", "tournament", "sus"};
+    for (int i = 0; i < islands; i++)
+    {
+        vector<string> args{"--selection", selections[i % 3], "--time-limit",
+                            timeLimit};
+        if (i % 2)
+            args.push_back("--niching");
+        engines.emplace_back(RunIsland, ref(race), "ga-" + to_string(i + 1),
+                             genetic, args);
+    }
+    {
+        unique_lock<mutex> guard(race.lock);
+        race.changed.wait(guard, [&race]() {
+            return !race.winner.empty() || race.unsolvable ||
+                   race.running == 0;
+        });
+        // Nobody can win any more; stop the rest
+        race.cancel = true;
+        for (Process* p : race.islands)
+            p->Kill();
+    }
+    for (auto& t : engines)
+        t.join();
+    if (race.winner.empty())
+    {
+        cout << "No solution" << endl;
+        return 1;
+    }
+    Sudoku sol = race.puzzle;
+    for (int cell = 0; cell < 81; cell++)
+        sol.Cell(cell / 9, cell % 9) = race.solution[cell];
+    cout << sol << "Winner " << race.winner << ' ' << race.wall << endl;
+    return 0;
+}
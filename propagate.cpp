@@ -0,0 +1,248 @@
+#include "propagate.h"
+#include <cstring>
+using namespace std;
+
+Propagator::Propagator()
+{
+    value.fill(0);
+    for (auto& c : cand)
+        c = 0x3FE;
+    memset(dirty, 0, sizeof(dirty));
+}
+
+Propagator::Propagator(const SolutionGrid& givens) : Propagator()
+{
+    for (int cell = 0; cell < 81; cell++)
+        if (givens[cell])
+            Assign(cell, givens[cell]);
+}
+
+void Propagator::MarkDirty(int cell)
+{
+    for (int u : CellUnits[cell])
+        if (!dirty[u])
+        {
+            dirty[u] = true;
+            dirtyList[ndirty++] = u;
+        }
+}
+
+bool Propagator::Assign(int cell, int digit)
+{
+    if (value[cell] || !(cand[cell] >> digit & 1))
+    {
+        contradiction |= value[cell] != digit;
+        return !contradiction;
+    }
+    Save(cell);
+    value[cell] = digit;
+    cand[cell] = 0;
+    filled++;
+    MarkDirty(cell);
+    for (int peer : CellPeers[cell])
+        Eliminate(peer, 1 << digit);
+    return !contradiction;
+}
+
+bool Propagator::Eliminate(int cell, uint16_t mask)
+{
+    if (value[cell] || !(cand[cell] & mask))
+        return false;
+    Save(cell);
+    cand[cell] &= ~mask;
+    if (!cand[cell])
+        contradiction = true;
+    else if (!(cand[cell] & (cand[cell] - 1)))
+        singles[singlesTail++] = cell;
+    MarkDirty(cell);
+    return true;
+}
+
+int Propagator::NakedSingles(bool oneWave)
+{
+    int placed = 0, end = singlesTail;
+    while (singlesHead != (oneWave ? end : singlesTail) && !contradiction)
+    {
+        int cell = singles[singlesHead++];
+        if (value[cell] || !cand[cell])
+            continue;
+        Assign(cell, __builtin_ctz(cand[cell]));
+        placed++;
+    }
+    if (singlesHead == singlesTail)
+        singlesHead = singlesTail = 0;
+    return placed;
+}
+
+int Propagator::HiddenSingles()
+{
+    int placed = 0;
+    while (ndirty && !contradiction)
+    {
+        int u = dirtyList[--ndirty];
+        dirty[u] = false;
+        // Digits that are candidates once and more than once, and placed
+        uint16_t once = 0, twice = 0, done = 0;
+        for (int cell : UnitCells[u])
+        {
+            twice |= once & cand[cell];
+            once |= cand[cell];
+            done |= value[cell] ? 1 << value[cell] : 0;
+        }
+        if ((once | done) != 0x3FE)
+        {
+            contradiction = true;
+            break;
+        }
+        for (uint16_t digits = once & ~twice & ~done; digits;
+             digits &= digits - 1)
+        {
+            int d = __builtin_ctz(digits);
+            for (int cell : UnitCells[u])
+                if (cand[cell] >> d & 1)
+                {
+                    Assign(cell, d);
+                    placed++;
+                    break;
+                }
+        }
+    }
+    return placed;
+}
+
+bool Propagator::Propagate()
+{
+    while (!contradiction)
+    {
+        NakedSingles();
+        if (contradiction || !HiddenSingles())
+            break;
+    }
+    return !contradiction;
+}
+
+void Propagator::Rollback(size_t checkpoint)
+{
+    while (trail.size() > checkpoint)
+    {
+        const TrailEntry& e = trail.back();
+        filled -= value[e.cell] && !e.value;
+        value[e.cell] = e.value;
+        cand[e.cell] = e.cand;
+        trail.pop_back();
+    }
+    contradiction = false;
+    singlesHead = singlesTail = 0;
+    for (int i = 0; i < ndirty; i++)
+        dirty[dirtyList[i]] = false;
+    ndirty = 0;
+}
+
+int Propagator::MostConstrained() const
+{
+    int best = -1, bestCount = 10;
+    for (int cell = 0; cell < 81; cell++)
+    {
+        if (value[cell])
+            continue;
+        int cnt = __builtin_popcount(cand[cell]);
+        if (cnt < bestCount)
+        {
+            best = cell;
+            bestCount = cnt;
+            if (cnt <= 1)
+                break;
+        }
+    }
+    return best;
+}
+
+struct SearchState
+{
+    Propagator prop;
+    long long found, maxresults, nodesLeft;
+    SolutionVisitor visitor;
+    void* visitorArgs;
+    ShuffleProc shuffler;
+    void* shufflerArgs;
+    const atomic<bool>* cancel;
+    bool stopped;
+};
+
+static void DFS(SearchState& st)
+{
+    if ((st.cancel && st.cancel->load(memory_order_relaxed)) ||
+        --st.nodesLeft == 0)
+    {
+        st.stopped = true;
+        return;
+    }
+    Propagator& p = st.prop;
+    if (!p.Propagate())
+        return;
+    int best = p.MostConstrained();
+    if (best == -1)
+    {
+        st.found++;
+        if (st.visitor && !st.visitor(p.Grid(), st.visitorArgs))
+            st.stopped = true;
+        if (st.found == st.maxresults)
+            st.stopped = true;
+        return;
+    }
+    uint16_t cand = p.Candidates(best);
+    size_t checkpoint = p.Checkpoint();
+    if (!st.shuffler)
+    {
+        for (; cand && !st.stopped; cand &= cand - 1)
+        {
+            p.Assign(best, __builtin_ctz(cand));
+            DFS(st);
+            p.Rollback(checkpoint);
+        }
+        return;
+    }
+    vector<int> digs;
+    for (; cand; cand &= cand - 1)
+        digs.push_back(__builtin_ctz(cand));
+    st.shuffler(digs, st.shufflerArgs);
+    for (size_t i = 0; i < digs.size() && !st.stopped; i++)
+    {
+        p.Assign(best, digs[i]);
+        DFS(st);
+        p.Rollback(checkpoint);
+    }
+}
+
+long long SearchSolutions(const SolutionGrid& givens, long long maxresults,
+                          SolutionVisitor visitor, void* visitorArgs,
+                          ShuffleProc shuffler, void* shufflerArgs,
+                          const atomic<bool>* cancel, long long maxNodes)
+{
+    return SearchSolutions(Propagator(givens), maxresults, visitor, visitorArgs,
+                           shuffler, shufflerArgs, cancel, maxNodes);
+}
+
+long long SearchSolutions(const Propagator& start, long long maxresults,
+                          SolutionVisitor visitor, void* visitorArgs,
+                          ShuffleProc shuffler, void* shufflerArgs,
+                          const atomic<bool>* cancel, long long maxNodes)
+{
+    // A 'maxNodes' of 0 never runs out: counting down from it never reaches
+    // 0 again
+    SearchState st{.prop = start,
+                   .found = 0,
+                   .maxresults = maxresults,
+                   .nodesLeft = maxNodes,
+                   .visitor = visitor,
+                   .visitorArgs = visitorArgs,
+                   .shuffler = shuffler,
+                   .shufflerArgs = shufflerArgs,
+                   .cancel = cancel,
+                   .stopped = false};
+    // The givens already clash: no solutions
+    if (st.prop.Contradiction())
+        return 0;
+    DFS(st);
+    return st.found;
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "solutiongrid.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Units 0-8 are rows, 9-17 columns, 18-26 boxes
+constexpr std::array<std::array<uint8_t, 9>, 27> MakeUnitCells()
+{
+    std::array<std::array<uint8_t, 9>, 27> units{};
+    for (int i = 0; i < 9; i++)
+        for (int j = 0; j < 9; j++)
+        {
+            units[i][j] = i * 9 + j;
+            units[9 + i][j] = j * 9 + i;
+            units[18 + i][j] = (i / 3 * 3 + j / 3) * 9 + i % 3 * 3 + j % 3;
+        }
+    return units;
+}
+constexpr auto UnitCells = MakeUnitCells();
+
+// The row, column, and box of every cell
+constexpr std::array<std::array<uint8_t, 3>, 81> MakeCellUnits()
+{
+    std::array<std::array<uint8_t, 3>, 81> res{};
+    for (int cell = 0; cell < 81; cell++)
+        res[cell] = {uint8_t(cell / 9), uint8_t(9 + cell % 9),
+                     uint8_t(18 + cell / 27 * 3 + cell % 9 / 3)};
+    return res;
+}
+constexpr auto CellUnits = MakeCellUnits();
+
+// The 20 other cells that share a unit with every cell
+constexpr std::array<std::array<uint8_t, 20>, 81> MakeCellPeers()
+{
+    std::array<std::array<uint8_t, 20>, 81> peers{};
+    for (int cell = 0; cell < 81; cell++)
+    {
+        int n = 0;
+        for (int other = 0; other < 81; other++)
+        {
+            bool shares = false;
+            for (int u : CellUnits[cell])
+                for (int v : CellUnits[other])
+                    shares |= u == v;
+            if (shares && other != cell)
+                peers[cell][n++] = other;
+        }
+    }
+    return peers;
+}
+constexpr auto CellPeers = MakeCellPeers();
+
+// Candidate masks (bit d for digit d) of all cells with naked and hidden
+// single propagation. Changes are tracked with worklists: the cells that went
+// down to one candidate and the units that changed since they were last
+// checked for hidden singles, so only the neighbourhood of a change is looked
+// at again. Every change is logged, so a search can go back to a checkpoint
+// cheaply.
+class Propagator
+{
+    struct TrailEntry
+    {
+        uint8_t cell, value;
+        uint16_t cand;
+    };
+    SolutionGrid value;
+    // Candidates of the empty cells; 0 for filled cells
+    uint16_t cand[81];
+    int filled = 0;
+    bool contradiction = false;
+    std::vector<TrailEntry> trail;
+    // The worklists
+    uint8_t singles[81];
+    int singlesHead = 0, singlesTail = 0;
+    bool dirty[27];
+    uint8_t dirtyList[27];
+    int ndirty = 0;
+
+    void MarkDirty(int cell);
+    void Save(int cell)
+    {
+        trail.push_back({uint8_t(cell), value[cell], cand[cell]});
+    }
+
+public:
+    // An empty grid
+    Propagator();
+    // A grid with the given digits (not propagated yet)
+    explicit Propagator(const SolutionGrid& givens);
+    // Puts 'digit' into 'cell' and removes it from the peers. Returns false
+    // on a contradiction.
+    bool Assign(int cell, int digit);
+    // Removes the digits of 'mask' from the candidates of an empty cell.
+    // Returns true if anything was removed.
+    bool Eliminate(int cell, uint16_t mask);
+    // Fills the cells that have one candidate left. With 'oneWave', only the
+    // cells that had one candidate before the call are filled. Returns the
+    // number of filled cells.
+    int NakedSingles(bool oneWave = false);
+    // Fills the digits that have one place left in a changed unit. Returns
+    // the number of filled cells.
+    int HiddenSingles();
+    // Applies both kinds of singles until nothing changes. Returns false on
+    // a contradiction.
+    bool Propagate();
+    // Checkpoints should be taken without a contradiction, after Propagate()
+    size_t Checkpoint() const
+    {
+        return trail.size();
+    }
+    // Undoes every change made after the checkpoint
+    void Rollback(size_t checkpoint);
+    // The empty cell with the fewest candidates, or -1 if the grid is full
+    int MostConstrained() const;
+
+    uint16_t Candidates(int cell) const
+    {
+        return cand[cell];
+    }
+    int Value(int cell) const
+    {
+        return value[cell];
+    }
+    const SolutionGrid& Grid() const
+    {
+        return value;
+    }
+    int Filled() const
+    {
+        return filled;
+    }
+    bool Contradiction() const
+    {
+        return contradiction;
+    }
+};
+
+// Enumerates the solutions of the grid 'givens': singles are propagated at
+// every node, then the most constrained cell is tried with each of its
+// candidates ('shuffler', if given, reorders them). Calls 'visitor' (if not
+// null) for every solution. Stops after 'maxresults' solutions (0 = no
+// limit), when the visitor returns false, as soon as '*cancel' becomes true,
+// or after 'maxNodes' search nodes (0 = no limit). Returns the number of
+// solutions found.
+long long SearchSolutions(const SolutionGrid& givens, long long maxresults,
+                          SolutionVisitor visitor, void* visitorArgs,
+                          ShuffleProc shuffler = nullptr,
+                          void* shufflerArgs = nullptr,
+                          const std::atomic<bool>* cancel = nullptr,
+                          long long maxNodes = 0);
+// The same, starting from a copy of 'start', e.g. with some candidates
+// eliminated beforehand
+long long SearchSolutions(const Propagator& start, long long maxresults,
+                          SolutionVisitor visitor, void* visitorArgs,
+                          ShuffleProc shuffler = nullptr,
+                          void* shufflerArgs = nullptr,
+                          const std::atomic<bool>* cancel = nullptr,
+                          long long maxNodes = 0);
@@ -8,22 +8,100 @@ struct Stats
 {
     int Max;
     double Avg;
+    ResourceUsage Usage;
+};
+
+// Parses the output of a solution line by line as it arrives. Only the
+// unfinished line is copied, so the memory does not grow with the output.
+class ReportParser
+{
+    // Longer lines are truncated; report lines are much shorter
+    static constexpr size_t MaxLine = 128;
+    char line[MaxLine];
+    size_t len = 0;
+    // True after the "REPORT" line
+    bool inReport = false;
+
+    void ParseLine(string_view str)
+    {
+        if (!inReport)
+        {
+            inReport = str == "REPORT";
+            return;
+        }
+        size_t space = str.find(' ');
+        if (space == string_view::npos)
+            return;
+        string_view key = str.substr(0, space);
+        const char* first = str.data() + space + 1;
+        const char* last = str.data() + str.size();
+        if (key == "Max")
+            from_chars(first, last, Report.Max);
+        else if (key == "Average")
+            from_chars(first, last, Report.Avg);
+    }
+
+public:
+    Stats Report{};
+
+    void Feed(const char* data, size_t n)
+    {
+        while (n)
+        {
+            auto nl = (const char*)memchr(data, '\n', n);
+            size_t take = nl ? nl - data : n;
+            // A whole line inside the chunk is parsed in place
+            if (!len && nl)
+                ParseLine({data, take});
+            else
+            {
+                size_t fit = min(take, MaxLine - len);
+                memcpy(line + len, data, fit);
+                len += fit;
+                if (nl)
+                {
+                    ParseLine({line, len});
+                    len = 0;
+                }
+            }
+            if (!nl)
+                break;
+            data = nl + 1;
+            n -= take + 1;
+        }
+    }
+
+    // Parses the last line if it has no line break
+    void Finish()
+    {
+        if (len)
+            ParseLine({line, len});
+        len = 0;
+    }
 };
 
 int main(int argc, char** argv)
 {
-    if (argc != 3)
+    if (argc != 3 && argc != 4)
     {
-        cout << "Usage: reporter solution.bin testdir" << endl;
+        cout << "Usage: reporter solution.bin testdir [jobs=1]" << endl;
         return 1;
     }
     string progFilename = argv[1];
     string testDir = argv[2];
-    map<int, vector<Stats>> reports;
+    int jobs = argc == 4 ? atoi(argv[3]) : 1;
     vector<filesystem::path> entries;
     for (auto& entry : filesystem::directory_iterator(testDir))
         entries.push_back(entry.path());
     sort(entries.begin(), entries.end());
+    vector<ReportParser> parsers(entries.size());
+    ProcessPool pool(
+        jobs, 0,
+        [](size_t job, const char* data, size_t len, void* params) {
+            (*(vector<ReportParser>*)params)[job].Feed(data, len);
+        },
+        &parsers);
+    vector<int> givens;
     for (auto& entry : entries)
     {
         string testcase;
@@ -32,42 +110,23 @@ int main(int argc, char** argv)
             testin << ifstream(entry, ios::in).rdbuf();
             testcase = testin.str();
         }
-        string testFilename = entry.filename().string();
-        cout << "Testing on " << testFilename << "..." << endl;
-        int given = 81 - count(testcase.begin(), testcase.end(), '-');
-        cout.flush();
-        Process proc(progFilename, {progFilename, "--report"}, {});
-        fputs(testcase.c_str(), proc.StdIN());
-        fflush(proc.StdIN());
-        proc.Wait();
-        string output;
-        {
-            char buf[128];
-            while (true)
-            {
-                char* res = fgets(buf, 128, proc.StdOUT());
-                if (res == 0)
-                    break;
-                output.insert(output.end(), buf, buf + strlen(buf));
-            }
-        }
-        const char* beginmark = "REPORT\n";
-        int start = output.find(beginmark);
-        start += strlen(beginmark);
-        stringstream str(output.substr(start));
-        Stats report;
-        while (true)
-        {
-            string key;
-            if (!(str >> key))
-                break;
-            if (key == "Max")
-                str >> report.Max;
-            else if (key == "Average")
-                str >> report.Avg;
-        }
-        reports[given].push_back(report);
+        givens.push_back(81 - count(testcase.begin(), testcase.end(), '-'));
+        pool.Submit(progFilename, {progFilename, "--report"}, {}, testcase);
+    }
+    // Results are stored in the order of the tests, not of the completions
+    vector<Stats> results(entries.size());
+    PoolResult res;
+    while (pool.Next(res))
+    {
+        cout << "Tested on " << entries[res.Job].filename().string() << endl;
+        Stats& report = results[res.Job];
+        parsers[res.Job].Finish();
+        report = parsers[res.Job].Report;
+        report.Usage = res.Usage;
     }
+    map<int, vector<Stats>> reports;
+    for (size_t i = 0; i < results.size(); i++)
+        reports[givens[i]].push_back(results[i]);
     cout << "--Stats--\n";
     cout << "{\n";
     for (auto& p : reports)
@@ -82,6 +141,21 @@ int main(int argc, char** argv)
         }
         double n = p.second.size();
         cout << "\"Max\": " << smax / n << ", \"Avg\": " << savg / n << ", ";
+        // Resource usage: mean CPU seconds, peak RSS, mean page faults and
+        // context switches per run
+        double cpu = 0, minflt = 0, majflt = 0, ctxsw = 0;
+        long maxrss = 0;
+        for (auto& s : p.second)
+        {
+            cpu += s.Usage.UserTime + s.Usage.SysTime;
+            minflt += s.Usage.MinorFaults;
+            majflt += s.Usage.MajorFaults;
+            ctxsw += s.Usage.VolContextSwitches + s.Usage.InvolContextSwitches;
+            maxrss = max(maxrss, s.Usage.MaxRSS);
+        }
+        cout << "\"CPU\": " << cpu / n << ", \"MaxRSS\": " << maxrss
+             << ", \"MinFlt\": " << minflt / n << ", \"MajFlt\": " << majflt / n
+             << ", \"CtxSw\": " << ctxsw / n << ", ";
         cout << "\"Avgs\": [";
         bool first = true;
         for (auto& s : p.second)
@@ -0,0 +1,200 @@
+#include "solutioncache.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+using namespace std;
+
+struct SolutionCache::Header
+{
+    char magic[8];
+    // Updated with atomic operations through a shared mapping
+    uint64_t hits, misses;
+    char reserved[40];
+};
+
+static const char Magic[8]{'S', 'D', 'K', 'C', 'A', 'C', 'H', '1'};
+// A record: the canonical puzzle, its solution in the canonical frame, a
+// marker and a checksum of the first 162 bytes
+static const size_t RecordSize = 164;
+static const unsigned char RecordMarker = 0xA5;
+
+static unsigned char Checksum(const unsigned char* data)
+{
+    unsigned sum = 0;
+    for (int i = 0; i < 162; i++)
+        sum = sum * 31 + data[i];
+    return sum ^ sum >> 8 ^ sum >> 16 ^ sum >> 24;
+}
+
+static uint64_t Hash(const unsigned char* grid)
+{
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325;
+    for (int i = 0; i < 81; i++)
+        h = (h ^ grid[i]) * 0x100000001b3;
+    return h;
+}
+
+static void Fail(const string& what)
+{
+    throw system_error(errno, generic_category(), what);
+}
+
+SolutionCache::Key::Key(const SolutionGrid& puzzle)
+    : canonical(Canonicalize(puzzle, &transform))
+{
+}
+
+SolutionCache::SolutionCache(const string& filename)
+{
+    static_assert(sizeof(Header) == 64);
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1)
+        Fail("open " + filename);
+    // The first process writes the header
+    flock(fd, LOCK_EX);
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        Fail("fstat " + filename);
+    if (st.st_size < (off_t)sizeof(Header))
+    {
+        Header h{};
+        memcpy(h.magic, Magic, sizeof(Magic));
+        if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+            Fail("write " + filename);
+    }
+    flock(fd, LOCK_UN);
+    void* p = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (p == MAP_FAILED)
+        Fail("mmap " + filename);
+    header = (Header*)p;
+    if (memcmp(header->magic, Magic, sizeof(Magic)) != 0)
+    {
+        munmap(header, sizeof(Header));
+        close(fd);
+        throw runtime_error(filename + " is not a solution cache");
+    }
+    Refresh();
+}
+
+SolutionCache::~SolutionCache()
+{
+    // Nothing can be done about a failure here; it would only leak the
+    // mapping
+    if (base && munmap(base, mapped) == -1)
+        perror("munmap solution cache");
+    if (munmap(header, sizeof(Header)) == -1)
+        perror("munmap solution cache header");
+    close(fd);
+}
+
+void SolutionCache::Refresh()
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        Fail("fstat");
+    size_t count = (st.st_size - sizeof(Header)) / RecordSize;
+    if (count == indexed)
+        return;
+    // Remap everything; the records are read-only for us
+    if (base && munmap(base, mapped) == -1)
+        Fail("munmap");
+    base = nullptr;
+    records = nullptr;
+    mapped = sizeof(Header) + count * RecordSize;
+    void* p = mmap(nullptr, mapped, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED)
+    {
+        mapped = indexed = 0;
+        index.clear();
+        Fail("mmap");
+    }
+    base = p;
+    records = (const unsigned char*)p + sizeof(Header);
+    for (; indexed < count; indexed++)
+    {
+        const unsigned char* rec = records + indexed * RecordSize;
+        if (rec[162] == RecordMarker && rec[163] == Checksum(rec))
+            index.emplace(Hash(rec), indexed);
+    }
+}
+
+long long SolutionCache::Find(const SolutionGrid& canonical) const
+{
+    auto [first, last] = index.equal_range(Hash(canonical.data()));
+    for (auto it = first; it != last; ++it)
+        if (memcmp(records + it->second * RecordSize, canonical.data(), 81) ==
+            0)
+            return it->second;
+    return -1;
+}
+
+bool SolutionCache::Lookup(const Key& key, SolutionGrid& solution)
+{
+    long long rec = Find(key.canonical);
+    if (rec == -1)
+    {
+        // Another process may have added it since
+        Refresh();
+        rec = Find(key.canonical);
+    }
+    if (rec == -1)
+    {
+        __atomic_fetch_add(&header->misses, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    __atomic_fetch_add(&header->hits, 1, __ATOMIC_RELAXED);
+    SolutionGrid canonicalSolution;
+    memcpy(canonicalSolution.data(), records + rec * RecordSize + 81, 81);
+    solution = ApplyInverse(key.transform, canonicalSolution);
+    return true;
+}
+
+void SolutionCache::Store(const Key& key, const SolutionGrid& solution)
+{
+    unsigned char rec[RecordSize];
+    SolutionGrid canonicalSolution = ApplyTransform(key.transform, solution);
+    memcpy(rec, key.canonical.data(), 81);
+    memcpy(rec + 81, canonicalSolution.data(), 81);
+    rec[162] = RecordMarker;
+    rec[163] = Checksum(rec);
+    flock(fd, LOCK_EX);
+    Refresh();
+    if (Find(key.canonical) == -1)
+    {
+        // Drop the tail of a record whose append was interrupted
+        off_t end = sizeof(Header) + indexed * RecordSize;
+        if (ftruncate(fd, end) == -1 ||
+            pwrite(fd, rec, RecordSize, end) != RecordSize)
+        {
+            flock(fd, LOCK_UN);
+            Fail("append to the solution cache");
+        }
+    }
+    flock(fd, LOCK_UN);
+    Refresh();
+}
+
+size_t SolutionCache::Size()
+{
+    Refresh();
+    return index.size();
+}
+
+uint64_t SolutionCache::Hits() const
+{
+    return __atomic_load_n(&header->hits, __ATOMIC_RELAXED);
+}
+
+uint64_t SolutionCache::Misses() const
+{
+    return __atomic_load_n(&header->misses, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "canonical.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// A persistent cache of solved puzzles, shared by all processes that open the
+// same file. Puzzles are stored in their canonical form, so a puzzle also
+// hits the cache when only a symmetric variant of it was solved before.
+//
+// The file is a header with the shared hit/miss counters followed by
+// fixed-size records that are only ever appended (under an exclusive flock).
+// Readers map the file and never lock; a record that was cut short by a
+// crash is ignored and overwritten by the next append.
+class SolutionCache
+{
+    struct Header;
+    int fd;
+    Header* header;
+    // The mapping of the whole file (for munmap) and its records part
+    void* base = nullptr;
+    const unsigned char* records = nullptr;
+    size_t mapped = 0, indexed = 0;
+    // Hash of the canonical puzzle -> record number
+    std::unordered_multimap<uint64_t, size_t> index;
+    // Maps and indexes the records appended since the last call
+    void Refresh();
+    long long Find(const SolutionGrid& canonical) const;
+
+public:
+    // The canonical form of a puzzle and the transform that produced it
+    struct Key
+    {
+        SolutionGrid canonical;
+        SymmetryTransform transform;
+        explicit Key(const SolutionGrid& puzzle);
+    };
+    // Opens the cache, creating the file if needed. Throws std::system_error
+    // if the file cannot be opened or mapped, and std::runtime_error if it
+    // is not a cache.
+    explicit SolutionCache(const std::string& filename);
+    SolutionCache(const SolutionCache&) = delete;
+    SolutionCache& operator=(const SolutionCache&) = delete;
+    ~SolutionCache();
+    // Writes the solution of the puzzle into 'solution' if it is cached.
+    // Counts a hit or a miss.
+    bool Lookup(const Key& key, SolutionGrid& solution);
+    // Adds the solution of the puzzle unless it is already cached
+    void Store(const Key& key, const SolutionGrid& solution);
+    // The number of cached puzzles and the counters of all processes
+    size_t Size();
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+};
@@ -0,0 +1,13 @@
+#pragma once
+#include <array>
+#include <vector>
+
+// The digits of a grid in a compact form: the digit at row r, column c is
+// grid[r * 9 + c], 0 for an empty cell. It does not depend on sudoku.h, so
+// genetic.cpp, which has its own Sudoku class, can use it too.
+typedef std::array<unsigned char, 81> SolutionGrid;
+
+// Reorders the candidate digits of a cell before a search tries them
+typedef void (*ShuffleProc)(std::vector<int>& digits, void* args);
+// Called for every solution found. Returning false stops the enumeration.
+typedef bool (*SolutionVisitor)(const SolutionGrid& solution, void* args);
@@ -1,59 +1,365 @@
 #include "sudokusolve.h"
+#include "propagate.h"
 #include "sudoku.h"
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 using namespace std;
 
-void NextUnknown(const Sudoku& s, int& x, int& y)
+// A partially filled grid together with, for every row, column, and block,
+// the bitmask of the digits used in it (bit d for digit d)
+struct Board
 {
-    do
+    SolutionGrid grid;
+    uint16_t rows[9], cols[9], blocks[9];
+
+    static int BlockOf(int cell)
+    {
+        return cell / 27 * 3 + cell % 9 / 3;
+    }
+    uint16_t Candidates(int cell) const
+    {
+        return ~(rows[cell / 9] | cols[cell % 9] | blocks[BlockOf(cell)]) &
+               0x3FE;
+    }
+    // Places 'digit' into an empty cell, or removes it if it is already there
+    void Toggle(int cell, int digit)
+    {
+        grid[cell] ^= digit;
+        rows[cell / 9] ^= 1 << digit;
+        cols[cell % 9] ^= 1 << digit;
+        blocks[BlockOf(cell)] ^= 1 << digit;
+    }
+    // Copies the digits of 's'. Returns false if they already clash.
+    bool Load(const Sudoku& s)
     {
-        x++;
-        if (x == 9)
-            y++, x = 0;
-    } while (y < 9 && s.Cell(y, x) != 0);
+        grid.fill(0);
+        memset(rows, 0, sizeof(rows));
+        memset(cols, 0, sizeof(cols));
+        memset(blocks, 0, sizeof(blocks));
+        for (int cell = 0; cell < 81; cell++)
+        {
+            int digit = s.Cell(cell / 9, cell % 9);
+            if (!digit)
+                continue;
+            if (!(Candidates(cell) & 1 << digit))
+                return false;
+            Toggle(cell, digit);
+        }
+        return true;
+    }
+    // Returns the empty cell with the fewest candidates and puts them into
+    // 'cand', or returns -1 if the grid is full
+    int MostConstrained(uint16_t& cand) const
+    {
+        int best = -1, bestCount = 10;
+        for (int cell = 0; cell < 81; cell++)
+        {
+            if (grid[cell])
+                continue;
+            uint16_t c = Candidates(cell);
+            int cnt = __builtin_popcount(c);
+            if (cnt < bestCount)
+            {
+                best = cell;
+                bestCount = cnt;
+                cand = c;
+                if (cnt <= 1)
+                    break;
+            }
+        }
+        return best;
+    }
+};
+
+long long EnumerateSolutions(const Sudoku& s, long long maxresults,
+                             SolutionVisitor visitor, void* visitorArgs,
+                             ShuffleProc shuffler, void* shufflerArgs,
+                             const atomic<bool>* cancel)
+{
+    SolutionGrid givens;
+    for (int cell = 0; cell < 81; cell++)
+        givens[cell] = s.Cell(cell / 9, cell % 9);
+    return SearchSolutions(givens, maxresults, visitor, visitorArgs, shuffler,
+                           shufflerArgs, cancel);
+}
+
+long long CountSolutions(const Sudoku& s, long long maxresults)
+{
+    return EnumerateSolutions(s, maxresults, nullptr, nullptr);
 }
 
-void DFS(Sudoku& cur, vector<Sudoku>& sols, int x, int y, int maxsols,
-         ShuffleProc shuffler, void* shArgs)
+// The search behind EnumerateSolutionsParallel. Every worker runs an
+// iterative DFS over its own explicit stack. When some worker is out of
+// work, the busy ones split off the shallowest untried branch of their stack
+// into their task queue, from which idle workers steal.
+class ParallelSearch
 {
-    if (y >= 9)
+    struct Worker
+    {
+        mutex lock;
+        deque<Board> tasks;
+    };
+    struct Frame
+    {
+        int cell;
+        // The digits not tried yet and the one currently placed (0 = none)
+        uint16_t left;
+        int placed;
+    };
+    unique_ptr<Worker[]> workers;
+    int nworkers;
+    long long maxresults;
+    atomic<long long> found{0};
+    // The number of tasks queued or being searched
+    atomic<int> pending{1};
+    // The number of workers waiting for a task
+    atomic<int> hungry{0};
+    atomic<bool> stop{false};
+    SolutionVisitor visitor;
+    void* visitorArgs;
+    const atomic<bool>* cancel;
+    // Visitors are called under this lock, one at a time
+    mutex visitLock;
+
+    bool Stopped() const
+    {
+        return stop.load(memory_order_relaxed) ||
+               (cancel && cancel->load(memory_order_relaxed));
+    }
+
+    void Report(const Board& b)
+    {
+        long long no = found.fetch_add(1) + 1;
+        if (maxresults && no >= maxresults)
+        {
+            stop = true;
+            // Another worker has already reported the last solution
+            if (no > maxresults)
+                return;
+        }
+        if (!visitor)
+            return;
+        lock_guard<mutex> guard(visitLock);
+        if (!visitor(b.grid, visitorArgs))
+            stop = true;
+    }
+
+    // Pushes the frame for the most constrained cell of 'b' onto the stack.
+    // Reports the solution if the grid is full.
+    void Expand(const Board& b, Frame* stack, int& depth)
+    {
+        uint16_t cand = 0;
+        int cell = b.MostConstrained(cand);
+        if (cell == -1)
+            Report(b);
+        else if (cand)
+            stack[depth++] = {cell, cand, 0};
+    }
+
+    // Moves one untried digit of the shallowest frame that has any into a
+    // new task
+    void Donate(int self, const Board& b, Frame* stack, int depth)
+    {
+        int i = 0;
+        while (i < depth && !stack[i].left)
+            i++;
+        if (i == depth)
+            return;
+        Board task = b;
+        for (int j = i; j < depth; j++)
+            if (stack[j].placed)
+                task.Toggle(stack[j].cell, stack[j].placed);
+        int digit = __builtin_ctz(stack[i].left);
+        stack[i].left &= stack[i].left - 1;
+        task.Toggle(stack[i].cell, digit);
+        pending++;
+        lock_guard<mutex> guard(workers[self].lock);
+        workers[self].tasks.push_back(task);
+    }
+
+    void Search(int self, Board& b)
+    {
+        Frame stack[81];
+        int depth = 0;
+        Expand(b, stack, depth);
+        while (depth > 0 && !Stopped())
+        {
+            Frame& f = stack[depth - 1];
+            if (f.placed)
+            {
+                b.Toggle(f.cell, f.placed);
+                f.placed = 0;
+            }
+            if (!f.left)
+            {
+                depth--;
+                continue;
+            }
+            if (hungry.load(memory_order_relaxed) > 0)
+            {
+                bool queued;
+                {
+                    lock_guard<mutex> guard(workers[self].lock);
+                    queued = !workers[self].tasks.empty();
+                }
+                if (!queued)
+                    Donate(self, b, stack, depth);
+                if (!f.left)
+                    continue;
+            }
+            int digit = __builtin_ctz(f.left);
+            f.left &= f.left - 1;
+            f.placed = digit;
+            b.Toggle(f.cell, digit);
+            Expand(b, stack, depth);
+        }
+    }
+
+    // Takes a task from the back of the worker's own queue or steals one
+    // from the front of another queue
+    bool TryTake(int self, Board& b)
+    {
+        for (int k = 0; k < nworkers; k++)
+        {
+            Worker& w = workers[(self + k) % nworkers];
+            lock_guard<mutex> guard(w.lock);
+            if (w.tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                b = w.tasks.back();
+                w.tasks.pop_back();
+            }
+            else
+            {
+                b = w.tasks.front();
+                w.tasks.pop_front();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void Run(int self)
+    {
+        Board b;
+        while (true)
+        {
+            if (!TryTake(self, b))
+            {
+                hungry++;
+                bool got = false;
+                while (!got && pending.load() > 0 && !Stopped())
+                {
+                    this_thread::yield();
+                    got = TryTake(self, b);
+                }
+                hungry--;
+                if (!got)
+                    return;
+            }
+            Search(self, b);
+            pending--;
+        }
+    }
+
+public:
+    ParallelSearch(const Board& root, int threads, long long maxresults,
+                   SolutionVisitor visitor, void* visitorArgs,
+                   const atomic<bool>* cancel)
+        : workers(new Worker[threads]), nworkers(threads),
+          maxresults(maxresults), visitor(visitor), visitorArgs(visitorArgs),
+          cancel(cancel)
     {
-        sols.push_back(cur);
-        return;
+        workers[0].tasks.push_back(root);
     }
-    int nx = x, ny = y;
-    NextUnknown(cur, nx, ny);
-    auto avail = cur.Available(y, x);
-    auto cell = cur.Cell(y, x);
-    vector<int> digs;
-    for (int i = 1; i <= 9; i++)
+
+    long long Execute()
     {
-        if (avail.test(i))
-            digs.push_back(i);
+        vector<thread> threads;
+        for (int i = 1; i < nworkers; i++)
+            threads.emplace_back([this, i]() { Run(i); });
+        Run(0);
+        for (auto& t : threads)
+            t.join();
+        long long res = found;
+        return maxresults && res > maxresults ? maxresults : res;
     }
-    shuffler(digs, shArgs);
-    for (int i : digs)
+};
+
+long long EnumerateSolutionsParallel(const Sudoku& s, long long maxresults,
+                                     SolutionVisitor visitor,
+                                     void* visitorArgs, int threads,
+                                     const atomic<bool>* cancel)
+{
+    Board root;
+    if (!root.Load(s))
+        return 0;
+    if (threads < 1)
+        threads = 1;
+    ParallelSearch search(root, threads, maxresults, visitor, visitorArgs,
+                          cancel);
+    return search.Execute();
+}
+
+long long CountSolutionsParallel(const Sudoku& s, long long maxresults,
+                                 int threads)
+{
+    return EnumerateSolutionsParallel(s, maxresults, nullptr, nullptr,
+                                      threads);
+}
+
+bool VerifySolution(const Sudoku& s, const SolutionGrid& grid)
+{
+    for (int i = 0; i < 9; i++)
     {
-        cell = i;
-        DFS(cur, sols, nx, ny, maxsols, shuffler, shArgs);
-        if (sols.size() == maxsols)
-            break;
+        int row = 0, col = 0, box = 0;
+        for (int j = 0; j < 9; j++)
+        {
+            row |= 1 << grid[i * 9 + j];
+            col |= 1 << grid[j * 9 + i];
+            box |= 1 << grid[(i / 3 * 3 + j / 3) * 9 + i % 3 * 3 + j % 3];
+        }
+        if (row != 0x3FE || col != 0x3FE || box != 0x3FE)
+            return false;
     }
-    cell = 0;
-    return;
+    for (int cell = 0; cell < 81; cell++)
+    {
+        int given = s.Cell(cell / 9, cell % 9);
+        if (given && given != grid[cell])
+            return false;
+    }
+    return true;
 }
 
 std::vector<Sudoku> SolveDFS(const Sudoku& s, int maxresults)
 {
-    return SolveDFS(s, maxresults, [](vector<int>&, void*){}, nullptr);
+    return SolveDFS(s, maxresults, nullptr, nullptr);
 }
 
 std::vector<Sudoku> SolveDFS(Sudoku s, int maxresults, ShuffleProc shuffler,
                              void* shuffleArgs)
 {
-    int x = -1, y = 0;
-    NextUnknown(s, x, y);
+    // Solutions keep the 'initial' flags of 's'
+    pair<const Sudoku*, vector<Sudoku>*> args;
     vector<Sudoku> res;
-    DFS(s, res, x, y, maxresults, shuffler, shuffleArgs);
+    args = {&s, &res};
+    EnumerateSolutions(
+        s, maxresults,
+        [](const SolutionGrid& grid, void* params) {
+            auto [orig, sols] =
+                *(pair<const Sudoku*, vector<Sudoku>*>*)params;
+            Sudoku sol = *orig;
+            for (int cell = 0; cell < 81; cell++)
+                sol.Cell(cell / 9, cell % 9) = grid[cell];
+            sols->push_back(sol);
+            return true;
+        },
+        &args, shuffler, shuffleArgs);
     return res;
 }
 
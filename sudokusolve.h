@@ -1,10 +1,39 @@
 #pragma once
+#include "solutiongrid.h"
 #include "sudoku.h"
+#include <array>
+#include <atomic>
 #include <vector>
 
-typedef void (*ShuffleProc)(std::vector<int>& digits, void* args);
+// Checks that 'grid' is a filled valid sudoku that keeps the digits of 's'
+bool VerifySolution(const Sudoku& s, const SolutionGrid& grid);
 
 std::vector<Sudoku> SolveDFS(const Sudoku& s, int maxresults);
 std::vector<Sudoku> SolveDFS(Sudoku s, int maxresults, ShuffleProc shuffler,
                              void* shufflerArgs);
 bool SolveDFS(Sudoku& s);
+
+// Calls 'visitor' (if not null) for every solution of 's' without storing
+// any of them. Stops after 'maxresults' solutions (0 = no limit), when the
+// visitor returns false, or as soon as '*cancel' becomes true. 'shuffler', if
+// given, reorders the candidate digits of every cell before they are tried.
+// Returns the number of solutions found.
+long long EnumerateSolutions(const Sudoku& s, long long maxresults,
+                             SolutionVisitor visitor, void* visitorArgs,
+                             ShuffleProc shuffler = nullptr,
+                             void* shufflerArgs = nullptr,
+                             const std::atomic<bool>* cancel = nullptr);
+// Counts the solutions of 's', stopping at 'maxresults' (0 = no limit)
+long long CountSolutions(const Sudoku& s, long long maxresults);
+
+// The same as EnumerateSolutions (without shuffling), but the search tree is
+// split between 'threads' threads that steal unexplored branches from each
+// other. The visitor is called from these threads, one call at a time.
+long long EnumerateSolutionsParallel(const Sudoku& s, long long maxresults,
+                                     SolutionVisitor visitor,
+                                     void* visitorArgs, int threads,
+                                     const std::atomic<bool>* cancel = nullptr);
+// Counts the solutions of 's' on 'threads' threads, stopping at 'maxresults'
+// (0 = no limit)
+long long CountSolutionsParallel(const Sudoku& s, long long maxresults,
+                                 int threads);
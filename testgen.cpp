@@ -1,5 +1,8 @@
 #include "sudoku.h"
+#include "propagate.h"
 #include "sudokusolve.h"
+#include <algorithm>
+#include <array>
 #include <climits>
 #include <cstdio>
 #include <cstdlib>
@@ -32,112 +35,161 @@ int RandInt(int min, int exmax)
     return RandInt(exmax - min) + min;
 }
 
-template <class T> void Shuffle(vector<T>& v, void*)
+// Fills an empty grid cell by cell, row by row, with random digits that do
+// not clash with the digit masks of the row, column, and box, and backtracks
+// on dead ends. Without propagation, this takes about a hundred steps on
+// average.
+struct RandomGrid
 {
-    int n = v.size();
-    for (int i = 0; i < n - 1; i++)
-        swap(v[i], v[RandInt(i, n)]);
-}
+    SolutionGrid grid{};
+    uint16_t rows[9]{}, cols[9]{}, boxes[9]{};
 
-vector<pair<int, int>> AllCoords()
-{
-    vector<pair<int, int>> coords(81);
-    for (int i = coords.size() - 1; i >= 0; i--)
-        coords[i] = {i / 9, i % 9};
-    return coords;
-}
+    void Toggle(int cell, int digit)
+    {
+        grid[cell] = digit;
+        rows[cell / 9] ^= 1 << digit;
+        cols[cell % 9] ^= 1 << digit;
+        boxes[cell / 27 * 3 + cell % 9 / 3] ^= 1 << digit;
+    }
+
+    bool Fill(int cell)
+    {
+        if (cell == 81)
+            return true;
+        uint16_t cand = ~(rows[cell / 9] | cols[cell % 9] |
+                          boxes[cell / 27 * 3 + cell % 9 / 3]) &
+                        0x3FE;
+        while (cand)
+        {
+            uint16_t bits = cand;
+            for (int skip = RandInt(__builtin_popcount(cand)); skip; skip--)
+                bits &= bits - 1;
+            int digit = __builtin_ctz(bits);
+            cand &= ~(1 << digit);
+            Toggle(cell, digit);
+            if (Fill(cell + 1))
+                return true;
+            Toggle(cell, digit);
+        }
+        return false;
+    }
+};
 
 Sudoku RandomSudoku()
 {
-    Sudoku empty;
-    auto v = SolveDFS(empty, 1, Shuffle<int>, nullptr);
-    return v[0];
+    RandomGrid rg;
+    rg.Fill(0);
+    Sudoku res;
+    for (int cell = 0; cell < 81; cell++)
+        res.Cell(cell / 9, cell % 9) = rg.grid[cell];
+    return res;
 }
 
-bool SingleSol(const Sudoku& s)
+// Whether 's' still has one solution after the given 'digit' was removed
+// from 'cell': the solution it had is still there, so there must be none
+// with another digit in the cell
+bool StillUnique(const Sudoku& s, int cell, int digit)
 {
-    auto res = SolveDFS(s, 2);
-    return res.size() == 1;
+    SolutionGrid grid;
+    for (int i = 0; i < 81; i++)
+        grid[i] = s[i / 9][i % 9];
+    Propagator p(grid);
+    p.Eliminate(cell, 1 << digit);
+    return SearchSolutions(p, 1, nullptr, nullptr) == 0;
 }
+// The greedy removal stops this many givens above the target, and StripTo()
+// may spend 'StripBudget' uniqueness checks on the rest
+const int StripSlack = 4, StripBudget = 200;
+// By default, a group is given up after this many grids in a row missed it
+// (a grid takes a few milliseconds)
+const int DefaultMaxAttempts = 20000;
 
-void StripSudoku(Sudoku& s)
+// The givens of 's' that are not locked, in the order they should be removed
+// in: the ones with the most givens among their peers first, as they are the
+// most likely to be redundant, with random tie-breaks
+vector<int> StripOrder(const Sudoku& s, const array<bool, 81>& locked)
 {
-    auto coords = AllCoords();
-    Shuffle(coords, nullptr);
-    for (auto& p : coords)
+    // (-priority, cell)
+    vector<pair<int, int>> order;
+    for (int cell = 0; cell < 81; cell++)
     {
-        auto cell = s.Cell(p.first, p.second);
-        int val = cell;
-        cell = 0;
-        if (SingleSol(s))
+        if (!s[cell / 9][cell % 9] || locked[cell])
             continue;
-        cell = val;
-        break;
+        int peers = 0;
+        for (int peer : CellPeers[cell])
+            peers += !!s[peer / 9][peer % 9];
+        order.push_back({-(peers * 128 + RandInt(128)), cell});
     }
+    sort(order.begin(), order.end());
+    vector<int> cells;
+    for (auto [priority, cell] : order)
+        cells.push_back(cell);
+    return cells;
 }
 
-int NumberOfDigits(const Sudoku& s)
-{
-    int res = 0;
-    for (int i = 0; i < 9; i++)
-        for (int j = 0; j < 9; j++)
-            res += !!s[i][j];
-    return res;
-}
-
-Sudoku LowDigitGen(int cnt)
+// Removes givens from 's', a puzzle with one solution and 'givens' givens,
+// in the order of StripOrder() without backtracking until 'target' are left
+// or none can be removed. A given that cannot be removed is locked: removing
+// more givens never makes the solution unique again. Returns the number of
+// givens left.
+int StripGreedy(Sudoku& s, int givens, int target, array<bool, 81>& locked)
 {
-    Sudoku sol = RandomSudoku();
-    auto coords = AllCoords();
-    while (true)
+    while (givens > target)
     {
-        for (int i = 0; i < cnt; i++)
-            swap(coords[i], coords[RandInt(i, 81)]);
-        Sudoku res;
-        for (int i = 0; i < cnt; i++)
+        bool removed = false;
+        for (int cell : StripOrder(s, locked))
         {
-            auto p = coords[i];
-            res.Cell(p.first, p.second) = sol[p.first][p.second];
+            auto digit = s.Cell(cell / 9, cell % 9);
+            int val = digit;
+            digit = 0;
+            if (StillUnique(s, cell, val))
+            {
+                removed = true;
+                break;
+            }
+            digit = val;
+            locked[cell] = true;
         }
-        if (SingleSol(res))
-            return res;
-    }
-}
-
-void RestoreDigits(Sudoku& s, const Sudoku& solution, int noDigits)
-{
-    vector<pair<int, int>> coords(81);
-    for (int i = coords.size() - 1; i >= 0; i--)
-        coords[i] = {i / 9, i % 9};
-    Shuffle(coords, nullptr);
-    for (auto p : coords)
-    {
-        auto cell = s.Cell(p.first, p.second);
-        if (!!cell)
-            continue;
-        cell = solution[p.first][p.second];
-        if (!--noDigits)
+        if (!removed)
             break;
+        givens--;
     }
+    return givens;
 }
 
-ostream& operator<<(ostream& out, const Sudoku& s)
+// Removes givens from 's' like StripGreedy() until exactly 'target' are left,
+// but when a branch gets stuck, the search backtracks and removes others. The
+// givens locked in a subtree are unlocked when the search leaves it. Returns
+// false after 'budget' uniqueness checks, leaving 's' as it was.
+bool StripTo(Sudoku& s, int givens, int target, array<bool, 81>& locked,
+             int& budget)
 {
-    for (int i = 0; i < 9; i++)
+    if (givens == target)
+        return true;
+    vector<int> order = StripOrder(s, locked), tried;
+    bool ok = false;
+    for (size_t i = 0; i < order.size(); i++)
     {
-        auto& row = s.Row(i);
-        for (int j = 0; j < 9; j++)
-        {
-            if (j)
-                out << ' ';
-            if (row[j])
-                out << row[j];
-            else
-                out << '-';
-        }
-        out << '\n';
+        // Siblings do not remove the givens tried before them, so too few may
+        // be left
+        if ((int)(order.size() - i) < givens - target || budget <= 0)
+            break;
+        int cell = order[i];
+        auto digit = s.Cell(cell / 9, cell % 9);
+        int val = digit;
+        digit = 0;
+        budget--;
+        ok = StillUnique(s, cell, val) &&
+             StripTo(s, givens - 1, target, locked, budget);
+        if (ok)
+            break;
+        digit = val;
+        locked[cell] = true;
+        tried.push_back(cell);
     }
-    return out;
+    for (int cell : tried)
+        locked[cell] = false;
+    return ok;
 }
 
 string MakeTestName(const string& dir, int noDigits, int testindex, int wDigits,
@@ -159,7 +211,8 @@ int main(int argc, char** argv)
     if (argc == 1)
     {
         cout << "Usage: testgen directory #OfTestsPerGroup startcount "
-                "endcount\n";
+                "endcount [maxGridsPerTest="
+             << DefaultMaxAttempts << "]\n";
         return 0;
     }
     string dir = argv[1];
@@ -171,9 +224,13 @@ int main(int argc, char** argv)
     int start = atoi(argv[3]);
     int end = atoi(argv[4]);
     int wDigits = strlen(argv[4]);
-    map<int, int> left;
+    int maxAttempts = argc > 5 ? atoi(argv[5]) : DefaultMaxAttempts;
+    // The tests still needed and the grids that missed the group since its
+    // last test, by the number of givens
+    map<int, int> left, attempts;
     for (int i = start; i <= end; i++)
         left[i] = noTests;
+    int unreachable = 0;
 
     int progress = 0, maxProgress = noTests * (end - start + 1);
     auto OutputProgress = [&]() -> void {
@@ -182,28 +239,29 @@ int main(int argc, char** argv)
     };
     while (left.size())
     {
-        Sudoku sol, s;
-        int noDigits;
-        sol = RandomSudoku();
-        int lim = 101;
-        do
+        Sudoku s = RandomSudoku();
+        // Aim at a random group that still needs tests: strip greedily down
+        // to near it and backtrack only over the last few levels. If this grid
+        // does not get there, try another one.
+        auto iter = next(left.begin(), RandInt(left.size()));
+        int noDigits = iter->first, budget = StripBudget;
+        array<bool, 81> locked{};
+        int givens = StripGreedy(s, 81, noDigits + StripSlack, locked);
+        if (givens > noDigits + StripSlack ||
+            !StripTo(s, givens, noDigits, locked, budget))
         {
-            lim--;
-            if (!lim)
-                break;
-            s = sol;
-            StripSudoku(s);
-            noDigits = NumberOfDigits(s);
-        } while (lim && noDigits > left.rbegin()->first);
-        if (!lim)
+            if (++attempts[noDigits] < maxAttempts)
+                continue;
+            cout << "\rGave up on " << noDigits << " givens after "
+                 << maxAttempts << " grids; made "
+                 << noTests - iter->second << " of " << noTests << endl;
+            unreachable++;
+            progress += iter->second;
+            left.erase(iter);
+            OutputProgress();
             continue;
-        auto iter = left.lower_bound(noDigits);
-        int needDigits = iter->first;
-        if (needDigits > noDigits)
-        {
-            RestoreDigits(s, sol, needDigits - noDigits);
-            noDigits = needDigits;
         }
+        attempts[noDigits] = 0;
         iter->second--;
         string filename = MakeTestName(dir, noDigits, noTests - iter->second,
                                        wDigits, wIndex);
@@ -215,4 +273,5 @@ int main(int argc, char** argv)
     }
     cout << "\nDone\n";
     fclose(randgen);
+    return unreachable ? 1 : 0;
 }
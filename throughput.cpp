@@ -0,0 +1,87 @@
+#include "bandsolve.h"
+#include "sudoku.h"
+#include "sudokusolve.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Finds one solution of 's' and writes it into 'grid'. Returns the number of
+// solutions found (0 or 1).
+typedef long long (*Engine)(const Sudoku& s, SolutionGrid& grid);
+
+bool KeepSolution(const SolutionGrid& grid, void* dest)
+{
+    *(SolutionGrid*)dest = grid;
+    return true;
+}
+
+const pair<const char*, Engine> Engines[]{
+    {"dfs",
+     [](const Sudoku& s, SolutionGrid& grid) {
+         return EnumerateSolutions(s, 1, KeepSolution, &grid);
+     }},
+    {"bands",
+     [](const Sudoku& s, SolutionGrid& grid) {
+         return EnumerateSolutionsBands(s, 1, KeepSolution, &grid);
+     }},
+};
+
+int main(int argc, char** argv)
+{
+    int repeats = argc < 3 ? 0 : atoi(argv[1]);
+    if (repeats < 1)
+    {
+        cout << "Usage: throughput repeats testDir... (repeats >= 1)" << endl;
+        return 1;
+    }
+    vector<Sudoku> puzzles;
+    for (int i = 2; i < argc; i++)
+    {
+        vector<filesystem::path> entries;
+        for (auto& entry : filesystem::directory_iterator(argv[i]))
+            entries.push_back(entry.path());
+        sort(entries.begin(), entries.end());
+        for (auto& entry : entries)
+        {
+            ifstream in(entry);
+            Sudoku s;
+            in >> s;
+            puzzles.push_back(s);
+        }
+    }
+    cout << puzzles.size() << " puzzles, " << repeats << " repeats\n";
+    int status = 0;
+    for (auto [name, engine] : Engines)
+    {
+        SolutionGrid grid;
+        int unsolved = 0, wrong = 0;
+        auto start = chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++)
+            for (const Sudoku& s : puzzles)
+            {
+                if (!engine(s, grid))
+                    unsolved++;
+                else if (r == 0 && !VerifySolution(s, grid))
+                    wrong++;
+            }
+        double secs =
+            chrono::duration<double>(chrono::steady_clock::now() - start)
+                .count();
+        double solved = (double)puzzles.size() * repeats;
+        cout << name << ": " << solved / secs << " puzzles/s, "
+             << secs / solved * 1e6 << " us/puzzle";
+        if (unsolved || wrong)
+        {
+            cout << " (" << unsolved << " unsolved, " << wrong << " wrong)";
+            status = 1;
+        }
+        cout << endl;
+    }
+    return status;
+}